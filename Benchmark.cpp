@@ -0,0 +1,653 @@
+/*
+	Copyright (c) 2020 Paul Espina
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "Benchmark.h"
+#include "Pixels.h"
+#include "PPU.h"
+#include "RomImage.h"
+#include "RomRegistry.h"
+#include "Z80.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+// Resident set size of the process in bytes, 0 where /proc/self/statm cannot be read.
+static size_t ResidentBytes()
+{
+#if defined(_WIN32)
+	return 0;
+#else
+	size_t pages = 0;
+	size_t resident = 0;
+	std::ifstream statm("/proc/self/statm");
+	if(!(statm >> pages >> resident))
+	{
+		return 0;
+	}
+	return resident * (size_t) sysconf(_SC_PAGESIZE);
+#endif
+}
+
+bool Benchmark::Run(const std::string &name)
+{
+	if(name == "flags")
+	{
+		Flags();
+		return true;
+	}
+	if(name == "jit")
+	{
+		Jit();
+		return true;
+	}
+	if(name == "timer")
+	{
+		TimerOverflows();
+		return true;
+	}
+	if(name == "ppu")
+	{
+		Ppu();
+		return true;
+	}
+	if(name == "pixels")
+	{
+		PixelKernels();
+		return true;
+	}
+	if(name == "pipeline")
+	{
+		Pipeline();
+		return true;
+	}
+	if(name == "formats")
+	{
+		Formats();
+		return true;
+	}
+	if(name == "damage")
+	{
+		Damage();
+		return true;
+	}
+	if(name == "halt")
+	{
+		Halt("roms/pokemonred.gb");
+		return true;
+	}
+	if(name == "polling")
+	{
+		Polling("roms/pokemonred.gb");
+		return true;
+	}
+	if(name == "blocks")
+	{
+		Blocks("roms/pokemonred.gb");
+		return true;
+	}
+	if(name == "load")
+	{
+		Load("roms/pokemonred.gb");
+		return true;
+	}
+	if(name == "instances")
+	{
+		Instances("roms/pokemonred.gb");
+		return true;
+	}
+	return false;
+}
+
+void Benchmark::LoadProgram(Z80 &cpu, const uint8_t *program, size_t size)
+{
+	std::vector<uint8_t> image(0x100 + size);
+	memcpy(&image[0x100], program, size);
+	cpu.InsertCartridge(RomImage::FromBytes(image.data(), image.size()));
+}
+
+void Benchmark::Flags()
+{
+	// ADD A,B; ADC A,C; SUB D; SBC A,E; AND H; OR L; XOR B; INC B; DEC C;
+	// CP $42; JR NZ,+0; JR C,+0; JR -17
+	const uint8_t program[] = {
+		0x80, 0x89, 0x92, 0x9b, 0xa4, 0xb5, 0xa8, 0x04, 0x0d,
+		0xfe, 0x42, 0x20, 0x00, 0x38, 0x00, 0x18, 0xef
+	};
+	const uint64_t instructions = 100000000;
+	std::unique_ptr<Z80> cpu(new Z80());
+	LoadProgram(*cpu, program, sizeof(program));
+	uint64_t cycles = 0;
+	auto start = std::chrono::steady_clock::now();
+	for(uint64_t i = 0; i < instructions; i++)
+	{
+		cycles += cpu->Dispatch(cpu->Fetch());
+	}
+	auto end = std::chrono::steady_clock::now();
+	double ns = std::chrono::duration<double, std::nano>(end - start).count();
+	std::cout << "flags: Z80_LAZY_FLAGS=" << Z80_LAZY_FLAGS << ", " << instructions << " instructions, "
+		<< cycles << " cycles, " << ns / instructions << " ns/instruction\n";
+}
+
+void Benchmark::Jit()
+{
+	// LD B,A; LD C,B; LD D,C; LD E,D; INC HL; DEC BC; LD H,E; LD L,H;
+	// ADD A,B; INC DE; LD A,L; INC A; JR -14
+	const uint8_t program[] = {
+		0x47, 0x48, 0x51, 0x5a, 0x23, 0x0b, 0x63, 0x6c,
+		0x80, 0x13, 0x7d, 0x3c, 0x18, 0xf2
+	};
+	const uint64_t target = 1000000000;
+	for(int enabled = 0; enabled < 2; enabled++)
+	{
+		std::unique_ptr<Z80> cpu(new Z80());
+		cpu->EnableJIT(enabled != 0);
+		LoadProgram(*cpu, program, sizeof(program));
+		uint64_t cycles = 0;
+		auto start = std::chrono::steady_clock::now();
+		while(cycles < target)
+		{
+			cycles += cpu->Step();
+		}
+		auto end = std::chrono::steady_clock::now();
+		double ns = std::chrono::duration<double, std::nano>(end - start).count();
+		std::cout << "jit: Z80_JIT=" << Z80_JIT << ", enabled=" << enabled << ", " << cycles << " cycles, "
+			<< ns / cycles << " ns/cycle\n";
+	}
+}
+
+void Benchmark::TimerOverflows()
+{
+	// TMA and TAC of each run: stopped, 262144 Hz from 0 and 262144 Hz from 0xff.
+	const uint8_t settings[3][2] = {{0x00, 0x00}, {0x00, 0x05}, {0xff, 0x05}};
+	const uint64_t target = 1000000000;
+	for(const uint8_t *setting : settings)
+	{
+		// LD A,TMA; LDH (TMA),A; LD A,TAC; LDH (TAC),A, then the loop of Jit.
+		const uint8_t program[] = {
+			0x3e, setting[0], 0xe0, 0x06, 0x3e, setting[1], 0xe0, 0x07,
+			0x47, 0x48, 0x51, 0x5a, 0x23, 0x0b, 0x63, 0x6c,
+			0x80, 0x13, 0x7d, 0x3c, 0x18, 0xf2
+		};
+		std::unique_ptr<Z80> cpu(new Z80());
+		LoadProgram(*cpu, program, sizeof(program));
+		uint64_t cycles = 0;
+		auto start = std::chrono::steady_clock::now();
+		while(cycles < target)
+		{
+			cycles += cpu->Step();
+		}
+		auto end = std::chrono::steady_clock::now();
+		double ns = std::chrono::duration<double, std::nano>(end - start).count();
+		std::cout << "timer: TMA=" << (int) setting[0] << ", TAC=" << (int) setting[1] << ", " << cycles << " cycles, "
+			<< ns / cycles << " ns/cycle, TIMA " << (int) cpu->ReadMem(0xff05) << "\n";
+	}
+}
+
+void Benchmark::Load(const std::string &path)
+{
+	const int runs = 200;
+	for(int mapped = 1; mapped >= 0; mapped--)
+	{
+		// Startup reads the header, a full pass touches every page like a long play session.
+		double startup = 0;
+		double full = 0;
+		uint32_t sum = 0;
+		for(int i = 0; i < runs; i++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			std::unique_ptr<RomImage> image = mapped ? RomImage::Load(path) : RomImage::Read(path);
+			if(image == nullptr)
+			{
+				std::cout << "ERROR:BENCHMARK::ROM_NOT_FOUND " << path << "\n";
+				return;
+			}
+			sum += image->Data()[0x147];
+			auto header = std::chrono::steady_clock::now();
+			for(size_t offset = 0; offset < image->Size(); offset += 4096)
+			{
+				sum += image->Data()[offset];
+			}
+			auto end = std::chrono::steady_clock::now();
+			startup += std::chrono::duration<double, std::micro>(header - start).count();
+			full += std::chrono::duration<double, std::micro>(end - start).count();
+		}
+		std::cout << "load: " << (mapped ? "mmap" : "read") << ", " << path << ", " << startup / runs
+			<< " us to header, " << full / runs << " us to every page (" << sum << ")\n";
+	}
+}
+
+void Benchmark::Halt(const std::string &path)
+{
+	const int frames = 3000;
+	// LD A,1; LDH (IE),A; HALT; XOR A; LDH (IF),A; JR -6
+	const uint8_t program[] = {0x3e, 0x01, 0xe0, 0xff, 0x76, 0xaf, 0xe0, 0x0f, 0x18, 0xfa};
+	for(int rom = 0; rom < 2; rom++)
+	{
+		std::unique_ptr<Z80> cpu(new Z80());
+		if(rom == 0)
+		{
+			LoadProgram(*cpu, program, sizeof(program));
+		}
+		else if(!cpu->LoadCartridge(path))
+		{
+			std::cout << "ERROR:BENCHMARK::ROM_NOT_FOUND " << path << "\n";
+			return;
+		}
+		cpu->SetRendering(false);
+		auto start = std::chrono::steady_clock::now();
+		for(int i = 0; i < frames; i++)
+		{
+			cpu->RunFrame();
+		}
+		auto end = std::chrono::steady_clock::now();
+		double us = std::chrono::duration<double, std::micro>(end - start).count() / frames;
+		std::cout << "halt: " << (rom == 0 ? "VBlank wait loop" : path) << ", headless, " << frames << " frames, "
+			<< us << " us/frame\n";
+	}
+}
+
+void Benchmark::Polling(const std::string &path)
+{
+	const int frames = 3000;
+	std::unique_ptr<Z80> cpus[2];
+	for(int skip = 0; skip < 2; skip++)
+	{
+		cpus[skip].reset(new Z80());
+		Z80 *cpu = cpus[skip].get();
+		// Without the .sav both runs start from the same empty cartridge RAM.
+		if(!cpu->LoadCartridge(path))
+		{
+			std::cout << "ERROR:BENCHMARK::ROM_NOT_FOUND " << path << "\n";
+			return;
+		}
+		cpu->EnablePollingSkip(skip != 0);
+		cpu->SetRendering(false);
+		auto start = std::chrono::steady_clock::now();
+		for(int i = 0; i < frames; i++)
+		{
+			cpu->RunFrame();
+		}
+		auto end = std::chrono::steady_clock::now();
+		double us = std::chrono::duration<double, std::micro>(end - start).count() / frames;
+		std::cout << "polling: " << path << ", headless, " << (skip ? "skipped" : "run") << ", " << frames << " frames, "
+			<< us << " us/frame\n";
+	}
+	bool same = cpus[0]->total_cycles == cpus[1]->total_cycles && cpus[0]->pc == cpus[1]->pc &&
+		memcmp(cpus[0]->memory, cpus[1]->memory, sizeof(cpus[0]->memory)) == 0;
+	std::cout << "polling: " << (same ? "identical" : "different") << " state after " << frames << " frames\n";
+	cpus[1]->ReportPollingLoops(std::cout);
+}
+
+void Benchmark::Blocks(const std::string &path)
+{
+	const int frames = 3000;
+	// Counts frames at 0xC000 from LY alone.
+	// LDH A,(LY); CP 0x90; JR NZ,-6; LD HL,0xC000; INC (HL); LDH A,(LY); CP 0x90; JR Z,-6; JR -18
+	const uint8_t polling[] = {0xf0, 0x44, 0xfe, 0x90, 0x20, 0xfa, 0x21, 0x00, 0xc0, 0x34, 0xf0, 0x44, 0xfe, 0x90, 0x28, 0xfa,
+		0x18, 0xee};
+	// LD A,1; LDH (IE),A; HALT; XOR A; LDH (IF),A; JR -6
+	const uint8_t halt[] = {0x3e, 0x01, 0xe0, 0xff, 0x76, 0xaf, 0xe0, 0x0f, 0x18, 0xfa};
+	for(int run = 0; run < 3; run++)
+	{
+		std::unique_ptr<Z80> cpus[2];
+		for(std::unique_ptr<Z80> &cpu : cpus)
+		{
+			cpu.reset(new Z80());
+			if(run == 0)
+			{
+				LoadProgram(*cpu, polling, sizeof(polling));
+			}
+			else if(run == 1)
+			{
+				LoadProgram(*cpu, halt, sizeof(halt));
+			}
+			else if(!cpu->LoadCartridge(path))
+			{
+				std::cout << "ERROR:BENCHMARK::ROM_NOT_FOUND " << path << "\n";
+				return;
+			}
+			cpu->SetRendering(false);
+		}
+		const char *name = run == 0 ? "LY polling loop" : run == 1 ? "VBlank wait loop" : path.c_str();
+		// RunUntil steps one instruction at a time whatever Z80_BLOCK_CACHE is.
+		std::chrono::steady_clock::duration times[2] = {};
+		uint32_t overshoot = 0;
+		int differs = -1;
+		for(int i = 0; i < frames && differs < 0; i++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			cpus[0]->RunFrame();
+			auto middle = std::chrono::steady_clock::now();
+			uint32_t target = Z80::FRAME_CYCLES - overshoot;
+			overshoot = cpus[1]->RunUntil([] { return false; }, target) - target;
+			auto end = std::chrono::steady_clock::now();
+			times[0] += middle - start;
+			times[1] += end - middle;
+			cpus[0]->FlushFlags();
+			cpus[1]->FlushFlags();
+			if(cpus[0]->total_cycles != cpus[1]->total_cycles || cpus[0]->pc != cpus[1]->pc || cpus[0]->sp != cpus[1]->sp ||
+				cpus[0]->IME != cpus[1]->IME || memcmp(cpus[0]->registers, cpus[1]->registers, sizeof(cpus[0]->registers)) != 0 ||
+				memcmp(cpus[0]->memory, cpus[1]->memory, sizeof(cpus[0]->memory)) != 0)
+			{
+				differs = i;
+			}
+		}
+		for(int stepped = 0; stepped < 2; stepped++)
+		{
+			double us = std::chrono::duration<double, std::micro>(times[stepped]).count() / frames;
+			std::cout << "blocks: " << name << ", headless, " << (stepped ? "instructions" : "blocks") << ", " << frames
+				<< " frames, " << us << " us/frame\n";
+		}
+		if(differs < 0)
+		{
+			std::cout << "blocks: " << name << ", identical state after " << frames << " frames\n";
+		}
+		else
+		{
+			std::cout << "blocks: " << name << ", different state from frame " << differs << "\n";
+		}
+		if(run == 0)
+		{
+			// The loop only counts if the blocks see LY change.
+			std::cout << "blocks: " << name << ", frames counted " << (int) cpus[0]->memory[0xc000] << ", expected "
+				<< frames % 256 << "\n";
+		}
+	}
+}
+
+void Benchmark::Instances(const std::string &path)
+{
+	const int count = 1000;
+	std::vector<std::unique_ptr<Z80>> cpus;
+	size_t resident = ResidentBytes();
+	auto start = std::chrono::steady_clock::now();
+	for(int i = 0; i < count; i++)
+	{
+		cpus.emplace_back(new Z80());
+		if(!cpus.back()->LoadCartridge(path))
+		{
+			std::cout << "ERROR:BENCHMARK::ROM_NOT_FOUND " << path << "\n";
+			return;
+		}
+	}
+	auto end = std::chrono::steady_clock::now();
+	double ms = std::chrono::duration<double, std::milli>(end - start).count();
+	// Each instance runs a frame so the memory it touches while running is resident too.
+	for(std::unique_ptr<Z80> &cpu : cpus)
+	{
+		cpu->SetRendering(false);
+		cpu->RunFrame();
+	}
+	size_t after = ResidentBytes();
+	std::cout << "instances: " << count << " instances of " << path << ", " << RomRegistry::Count() << " ROM images of "
+		<< cpus[0]->rom->Size() / 1024 << " KiB, " << sizeof(Z80) / 1024 << " KiB per instance, " << ms << " ms\n";
+	if(resident != 0 && after != 0)
+	{
+		std::cout << "instances: resident set grew " << (after - resident) / 1024 << " KiB after a frame each, "
+			<< (after - resident) / count / 1024 << " KiB per instance\n";
+	}
+}
+
+void Benchmark::Ppu()
+{
+	const int frames = 3000;
+	std::unique_ptr<uint8_t[]> memory(new uint8_t[0x10000]);
+	std::unique_ptr<uint8_t[][PPU::WIDTH]> screen(new uint8_t[PPU::HEIGHT][PPU::WIDTH]);
+	uint32_t x = 1;
+	for(int i = 0; i < 0x10000; i++)
+	{
+		x = x * 1103515245 + 12345;
+		memory[i] = x >> 16;
+	}
+	// Background, window from line 72 and 8x16 sprites.
+	memory[0xff40] = 0xe7;
+	memory[0xff4a] = 72;
+	memory[0xff4b] = 87;
+	for(int headless = 0; headless < 2; headless++)
+	{
+		PPU ppu(memory.get(), screen.get());
+		ppu.SetRendering(!headless);
+		ppu.Reset();
+		auto start = std::chrono::steady_clock::now();
+		for(int i = 0; i < frames; i++)
+		{
+			ppu.Advance(Z80::FRAME_CYCLES);
+		}
+		auto end = std::chrono::steady_clock::now();
+		double us = std::chrono::duration<double, std::micro>(end - start).count() / frames;
+		std::cout << "ppu: " << (headless ? "headless, " : "") << ppu.Frames() << " frames, " << us << " us/frame, "
+			<< 1000000.0 / 59.7275 / us << "x real time\n";
+	}
+}
+
+void Benchmark::PixelKernels()
+{
+	const int lines = 200000;
+	const int rows = PPU::TILES * 8;
+	std::vector<uint8_t> planes(rows * 2);
+	std::vector<uint8_t> tiles(rows * 8);
+	uint8_t colors[PPU::WIDTH];
+	uint8_t sprites[PPU::WIDTH];
+	uint8_t pixels[PPU::WIDTH];
+	uint32_t x = 1;
+	for(size_t i = 0; i < planes.size(); i++)
+	{
+		x = x * 1103515245 + 12345;
+		planes[i] = x >> 16;
+	}
+	for(int i = 0; i < PPU::WIDTH; i++)
+	{
+		colors[i] = planes[i] & 0x03;
+		sprites[i] = planes[i + PPU::WIDTH] & 0x93;
+	}
+	for(int level = 0; level <= (int) Pixels::Supported(); level++)
+	{
+		const Pixels::Kernels &kernels = Pixels::Get((Pixels::Level) level);
+		auto start = std::chrono::steady_clock::now();
+		for(int i = 0; i < lines * PPU::WIDTH / (rows * 8); i++)
+		{
+			kernels.decode(planes.data(), tiles.data(), rows);
+		}
+		auto decoded = std::chrono::steady_clock::now();
+		for(int i = 0; i < lines; i++)
+		{
+			kernels.palette(colors, (uint8_t) i, pixels, PPU::WIDTH);
+		}
+		auto mapped = std::chrono::steady_clock::now();
+		for(int i = 0; i < lines; i++)
+		{
+			kernels.composite(colors, sprites, (uint8_t) i, 0xe4, pixels, PPU::WIDTH);
+		}
+		auto composited = std::chrono::steady_clock::now();
+		const uint32_t rgba[4] = {0xffffffff, 0xffaaaaaa, 0xff555555, 0xff000000};
+		uint32_t expanded[PPU::WIDTH];
+		for(int i = 0; i < lines; i++)
+		{
+			kernels.expand(pixels, rgba, sizeof(uint32_t), expanded, PPU::WIDTH);
+		}
+		auto converted = std::chrono::steady_clock::now();
+		double count = (double) lines * PPU::WIDTH;
+		std::cout << "pixels: " << Pixels::Name((Pixels::Level) level)
+			<< " decode " << count / std::chrono::duration<double, std::nano>(decoded - start).count()
+			<< ", palette " << count / std::chrono::duration<double, std::nano>(mapped - decoded).count()
+			<< ", composite " << count / std::chrono::duration<double, std::nano>(composited - mapped).count()
+			<< ", expand to RGBA8888 " << count / std::chrono::duration<double, std::nano>(converted - composited).count()
+			<< " pixels/ns\n";
+	}
+}
+
+void Benchmark::Pipeline()
+{
+	// LD HL,$8000; loop: LD (HL+),A; INC A; LDH (SCX),A; LD ($fe05),A;
+	// BIT 5,H; JR Z,+2; LD H,$80; LD B,20; DEC B; JR NZ,-3; JR loop
+	const uint8_t program[] = {
+		0x21, 0x00, 0x80, 0x22, 0x3c, 0xe0, 0x43, 0xea, 0x05, 0xfe,
+		0xcb, 0x6c, 0x28, 0x02, 0x26, 0x80, 0x06, 0x14, 0x05, 0x20, 0xfd, 0x18, 0xec
+	};
+	const int frames = 2000;
+	std::vector<uint64_t> hashes[2];
+	for(int threaded = 0; threaded < 2; threaded++)
+	{
+		std::unique_ptr<Z80> cpu(new Z80());
+		LoadProgram(*cpu, program, sizeof(program));
+		// Random tiles and sprites, background, window and 8x16 sprites on.
+		uint32_t x = 1;
+		for(int addr = 0x8000; addr < 0xa000; addr++)
+		{
+			x = x * 1103515245 + 12345;
+			cpu->memory[addr] = x >> 16;
+		}
+		for(int addr = 0xfe00; addr < 0xfea0; addr++)
+		{
+			x = x * 1103515245 + 12345;
+			cpu->memory[addr] = x >> 16;
+		}
+		cpu->memory[0xff40] = 0xe7;
+		cpu->memory[0xff4a] = 72;
+		cpu->memory[0xff4b] = 87;
+		cpu->ppu.Reset();
+		cpu->SchedulePPU();
+		cpu->EnableRenderThread(threaded != 0);
+		double waiting = 0;
+		auto start = std::chrono::steady_clock::now();
+		for(int i = 0; i < frames; i++)
+		{
+			cpu->RunFrame();
+			auto ran = std::chrono::steady_clock::now();
+			cpu->SyncScreen();
+			waiting += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - ran).count();
+			uint64_t hash = 1469598103934665603ull;
+			for(int y = 0; y < PPU::HEIGHT; y++)
+			{
+				for(int column = 0; column < PPU::WIDTH; column++)
+				{
+					hash = (hash ^ cpu->screen[y][column]) * 1099511628211ull;
+				}
+			}
+			hashes[threaded].push_back(hash);
+		}
+		auto end = std::chrono::steady_clock::now();
+		double us = std::chrono::duration<double, std::micro>(end - start).count() / frames;
+		std::cout << "pipeline: " << (threaded ? "render thread" : "in line") << ", " << frames << " frames, "
+			<< us << " us/frame, " << waiting / frames << " us from RunFrame to a complete screen"
+			<< (threaded ? (hashes[0] == hashes[1] ? ", identical" : ", DIFFERENT") : "") << "\n";
+	}
+}
+
+void Benchmark::Formats()
+{
+	const int frames = 3000;
+	const PixelFormat formats[] = {PixelFormat::INDEXED2, PixelFormat::GRAY8, PixelFormat::RGB565, PixelFormat::RGBA8888};
+	const char *names[] = {"indexed2", "gray8", "rgb565", "rgba8888"};
+	std::unique_ptr<uint8_t[]> memory(new uint8_t[0x10000]);
+	std::unique_ptr<uint8_t[][PPU::WIDTH]> screen(new uint8_t[PPU::HEIGHT][PPU::WIDTH]);
+	uint32_t x = 1;
+	for(int i = 0; i < 0x10000; i++)
+	{
+		x = x * 1103515245 + 12345;
+		memory[i] = x >> 16;
+	}
+	memory[0xff40] = 0xe7;
+	memory[0xff4a] = 72;
+	memory[0xff4b] = 87;
+	// Each format drawn straight into a host buffer, then RGBA8888 converted from screen after every frame.
+	for(int i = 0; i <= 4; i++)
+	{
+		PixelFormat format = i < 4 ? formats[i] : PixelFormat::RGBA8888;
+		size_t pitch = PPU::WIDTH * Renderer::BytesPerPixel(format);
+		std::vector<uint32_t> buffer(PPU::HEIGHT * pitch / sizeof(uint32_t));
+		PPU ppu(memory.get(), screen.get());
+		if(i < 4)
+		{
+			ppu.SetOutput(buffer.data(), pitch, format);
+		}
+		auto start = std::chrono::steady_clock::now();
+		for(int frame = 0; frame < frames; frame++)
+		{
+			ppu.Advance(Z80::FRAME_CYCLES);
+			if(i == 4)
+			{
+				static const uint32_t RGBA[4] = {0xffffffff, 0xffaaaaaa, 0xff555555, 0xff000000};
+				for(int y = 0; y < PPU::HEIGHT; y++)
+				{
+					for(int column = 0; column < PPU::WIDTH; column++)
+					{
+						buffer[y * PPU::WIDTH + column] = RGBA[screen[y][column]];
+					}
+				}
+			}
+		}
+		auto end = std::chrono::steady_clock::now();
+		double us = std::chrono::duration<double, std::micro>(end - start).count() / frames;
+		std::cout << "formats: " << (i < 4 ? names[i] : "rgba8888 converted from screen") << ", " << us << " us/frame\n";
+	}
+}
+
+void Benchmark::Damage()
+{
+	const int frames = 3000;
+	std::unique_ptr<uint8_t[]> memory(new uint8_t[0x10000]);
+	std::unique_ptr<uint8_t[][PPU::WIDTH]> screen(new uint8_t[PPU::HEIGHT][PPU::WIDTH]);
+	uint32_t x = 1;
+	for(int i = 0; i < 0x10000; i++)
+	{
+		x = x * 1103515245 + 12345;
+		memory[i] = x >> 16;
+	}
+	// Background only, one tile of the visible map changed per frame.
+	memory[0xff40] = 0x91;
+	memory[0xff42] = 0;
+	memory[0xff43] = 0;
+	PPU ppu(memory.get(), screen.get());
+	uint64_t lines = 0;
+	uint64_t rects = 0;
+	uint64_t pixels = 0;
+	auto start = std::chrono::steady_clock::now();
+	for(int i = 0; i < frames; i++)
+	{
+		uint16_t entry = 0x9800 + (i % 18) * 32 + (i * 7) % 20;
+		ppu.WriteVRAM(entry, memory[entry] + 1);
+		ppu.Advance(Z80::FRAME_CYCLES);
+		Renderer::Damage damage = ppu.LastDamage();
+		Renderer::Rect rect[8];
+		size_t count = damage.Rects(rect, 8);
+		lines += damage.Count();
+		rects += count;
+		for(size_t j = 0; j < count; j++)
+		{
+			pixels += rect[j].width * rect[j].height;
+		}
+	}
+	auto end = std::chrono::steady_clock::now();
+	double us = std::chrono::duration<double, std::micro>(end - start).count() / frames;
+	std::cout << "damage: " << frames << " frames, " << (double) lines / frames << " of " << PPU::HEIGHT << " lines, "
+		<< (double) rects / frames << " rects, " << 100.0 * pixels / ((double) frames * PPU::WIDTH * PPU::HEIGHT)
+		<< "% of pixels changed per frame, " << us << " us/frame\n";
+}
@@ -0,0 +1,70 @@
+/*
+	Copyright (c) 2020 Paul Espina
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+class Z80;
+
+// Micro-benchmarks of the emulator core, run with "gb-emulator --bench <name>".
+class Benchmark
+{
+public:
+	// Runs the benchmark called name, returns false if there is none.
+	static bool Run(const std::string &name);
+private:
+	// Inserts a cartridge holding program at 0x100, where execution starts.
+	static void LoadProgram(Z80 &cpu, const uint8_t *program, size_t size);
+	// Loop of ALU operations and conditional jumps, compare builds with Z80_LAZY_FLAGS 0 and 1.
+	static void Flags();
+	// Register moves and 16-bit increments through Step, with the JIT switched off and on.
+	static void Jit();
+	// The Jit loop with the timer stopped, overflowing every 4096 T-states and every 16.
+	static void TimerOverflows();
+	// Frames of background, window and sprites rendered by the PPU alone, then without drawing.
+	static void Ppu();
+	// Frames of a program writing VRAM, OAM and SCX drawn in line and on the render thread,
+	// with the wait for the screen after each frame and whether the frames match.
+	static void Pipeline();
+	// Frames drawn into a host buffer in each pixel format, against converting screen afterwards.
+	static void Formats();
+	// Lines and rectangles reported changed when one background tile changes per frame.
+	static void Damage();
+	// Throughput of each level of the pixel kernels on line-sized buffers.
+	static void PixelKernels();
+	// Headless frames of a program halting until each VBlank, then of the ROM at path.
+	static void Halt(const std::string &path);
+	// Headless frames of the ROM at path with polling loops run and skipped, whether they end the
+	// same, and the loops found.
+	static void Polling(const std::string &path);
+	// Headless frames of a program polling LY, of the VBlank wait loop and of the ROM at path, run by
+	// RunFrame, in blocks with Z80_BLOCK_CACHE, and by RunUntil, an instruction at a time, and
+	// whether their state stays the same.
+	static void Blocks(const std::string &path);
+	// Startup latency of RomImage::Load against RomImage::Read on the ROM at path.
+	static void Load(const std::string &path);
+	// Creates many instances running the ROM at path, they share one image. Reports the time to create
+	// them and how much the resident set grows once each has run a frame.
+	static void Instances(const std::string &path);
+};
@@ -0,0 +1,806 @@
+/*
+	Copyright (c) 2020 Paul Espina
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "JIT.h"
+#include "SaveRam.h"
+
+#if Z80_JIT
+
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+JIT::JIT()
+{
+	arena = nullptr;
+	arena_used = 0;
+	scratch = nullptr;
+	generation = 1;
+	registers_offset = 0;
+	sp_offset = 0;
+	pc_offset = 0;
+	block_exit_offset = 0;
+	read_pages_offset = 0;
+	write_pages_offset = 0;
+	pending_flags_offset = 0;
+	flags_pending_offset = 0;
+	slow_jump = 0;
+}
+
+JIT::~JIT()
+{
+	FreeExecutable(arena, ARENA_SIZE);
+	FreeExecutable(scratch, SCRATCH_SIZE);
+}
+
+uint8_t *JIT::AllocateExecutable(size_t size)
+{
+#if defined(_WIN32)
+	return (uint8_t *) VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+	void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return memory == MAP_FAILED ? nullptr : (uint8_t *) memory;
+#endif
+}
+
+void JIT::FreeExecutable(uint8_t *memory, size_t size)
+{
+	if(memory == nullptr)
+	{
+		return;
+	}
+#if defined(_WIN32)
+	VirtualFree(memory, 0, MEM_RELEASE);
+#else
+	munmap(memory, size);
+#endif
+}
+
+bool JIT::Protect(uint8_t *memory, size_t size, bool executable)
+{
+#if defined(_WIN32)
+	DWORD previous;
+	return VirtualProtect(memory, size, executable ? PAGE_EXECUTE_READ : PAGE_READWRITE, &previous) != 0;
+#else
+	return mprotect(memory, size, executable ? PROT_READ | PROT_EXEC : PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+void JIT::FindOffsets(Z80 &cpu)
+{
+	uint8_t *base = (uint8_t *) &cpu;
+	registers_offset = (int32_t) ((uint8_t *) &cpu.registers - base);
+	sp_offset = (int32_t) ((uint8_t *) &cpu.sp - base);
+	pc_offset = (int32_t) ((uint8_t *) &cpu.pc - base);
+	block_exit_offset = (int32_t) ((uint8_t *) &cpu.block_exit - base);
+	read_pages_offset = (int32_t) ((uint8_t *) &cpu.read_pages - base);
+	write_pages_offset = (int32_t) ((uint8_t *) &cpu.write_pages - base);
+	pending_flags_offset = (int32_t) ((uint8_t *) &cpu.pending_flags - base);
+	flags_pending_offset = (int32_t) ((uint8_t *) &cpu.flags_pending - base);
+}
+
+uint32_t JIT::Generation() const
+{
+	return generation;
+}
+
+Z80::JitCode JIT::Compile(Z80 &cpu, const Z80::Block &block)
+{
+	if(arena == nullptr)
+	{
+		arena = AllocateExecutable(ARENA_SIZE);
+		if(arena == nullptr)
+		{
+			return nullptr;
+		}
+		FindOffsets(cpu);
+	}
+	Translate(cpu, block);
+	if(arena_used + code.size() > ARENA_SIZE)
+	{
+		// Start over, code translated before is dropped by the generation change.
+		arena_used = 0;
+		generation++;
+	}
+	// Only the pages copied into are writable, and only while copying.
+	size_t first = arena_used & ~(PAGE_SIZE - 1);
+	size_t last = (arena_used + code.size() + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+	if(!Protect(arena + first, last - first, false))
+	{
+		return nullptr;
+	}
+	uint8_t *entry = arena + arena_used;
+	memcpy(entry, code.data(), code.size());
+	arena_used += code.size();
+	if(!Protect(arena + first, last - first, true))
+	{
+		// Code sharing the pages cannot run either.
+		std::cout << "ERROR:JIT::PROTECT\n";
+		generation++;
+		return nullptr;
+	}
+	return (Z80::JitCode) entry;
+}
+
+int32_t JIT::Register8Offset(uint8_t index)
+{
+	// B, C, D, E, H, L, (HL), A to (pair, high byte), x86-64 is little endian.
+	static const int32_t OFFSETS[8] = {2 * BC + 1, 2 * BC, 2 * DE + 1, 2 * DE, 2 * HL + 1, 2 * HL, -1, 2 * AF + 1};
+	return registers_offset + OFFSETS[index];
+}
+
+bool JIT::TranslateNative(Z80 &cpu, const Z80::MicroOp &op)
+{
+	if(op.prefixed)
+	{
+		return false;
+	}
+	uint8_t opcode = op.opcode;
+	uint8_t dst = (opcode >> 3) & 0x07;
+	uint8_t src = opcode & 0x07;
+	if(opcode == 0x00)
+	{
+		return true;
+	}
+	if(opcode >= 0x40 && opcode < 0x80 && opcode != 0x76)
+	{
+		if(src == 6)
+		{
+			// LD r,(HL): mov [rbx + dst], cl
+			EmitLoadHL();
+			EmitRbx(0x88, 1, Register8Offset(dst));
+			return true;
+		}
+		if(dst == 6)
+		{
+			// LD (HL),r
+			EmitStoreHL(src, 0);
+			return true;
+		}
+		// LD r,r': mov al, [rbx + src]; mov [rbx + dst], al
+		EmitRbx(0x8a, 0, Register8Offset(src));
+		EmitRbx(0x88, 0, Register8Offset(dst));
+		return true;
+	}
+	if(opcode == 0x36)
+	{
+		// LD (HL),n
+		EmitStoreHL(6, cpu.ReadMem(op.pc));
+		return true;
+	}
+	if(opcode < 0x40 && src == 6)
+	{
+		// LD r,n: mov byte [rbx + dst], n
+		EmitRbx(0xc6, 0, Register8Offset(dst));
+		Emit8(cpu.ReadMem(op.pc));
+		return true;
+	}
+	if(opcode < 0x40 && src == 3)
+	{
+		// INC rr / DEC rr: inc/dec word [rbx + rr]
+		int pair = opcode >> 4;
+		static const int PAIRS[3] = {BC, DE, HL};
+		int32_t offset = pair == 3 ? sp_offset : registers_offset + 2 * PAIRS[pair];
+		Emit8(0x66);
+		EmitRbx(0xff, opcode & 0x08 ? 1 : 0, offset);
+		return true;
+	}
+	if(opcode == 0xf9)
+	{
+		// LD SP,HL: mov ax, [rbx + hl]; mov [rbx + sp], ax
+		Emit8(0x66);
+		EmitRbx(0x8b, 0, registers_offset + 2 * HL);
+		Emit8(0x66);
+		EmitRbx(0x89, 0, sp_offset);
+		return true;
+	}
+#if Z80_LAZY_FLAGS
+	// ALU A,r / ALU A,(HL) / ALU A,n, but ADC and SBC which read C.
+	if(((opcode >= 0x80 && opcode < 0xc0) || (opcode >= 0xc0 && src == 6)) && dst != 1 && dst != 3)
+	{
+		if(opcode >= 0xc0)
+		{
+			// mov cl, n
+			Emit8(0xb1);
+			Emit8(cpu.ReadMem(op.pc));
+		}
+		else if(src == 6)
+		{
+			EmitLoadHL();
+		}
+		else
+		{
+			// mov cl, [rbx + src]
+			EmitRbx(0x8a, 1, Register8Offset(src));
+		}
+		EmitALU(dst);
+		return true;
+	}
+	if(opcode < 0x40 && (src == 4 || src == 5) && dst != 6)
+	{
+		// INC r / DEC r keep C: copy it from F into the pending flags unless they hold it already.
+		// cmp byte [rbx + flags_pending], 0; jne over
+		int32_t flags = pending_flags_offset;
+		EmitRbx(0x80, 7, flags_pending_offset);
+		Emit8(0x00);
+		Emit8(0x75);
+		size_t over = code.size();
+		Emit8(0x00);
+		// mov al, [rbx + f]; shr al, 4; and al, 1; mov [rbx + c], al
+		EmitRbx(0x8a, 0, registers_offset + 2 * AF);
+		Emit8(0xc0);
+		Emit8(0xe8);
+		Emit8(FLAG_C + 4);
+		Emit8(0x24);
+		Emit8(0x01);
+		EmitRbx(0x88, 0, flags + offsetof(Z80::PendingFlags, c));
+		Patch8(over, (uint8_t) (code.size() - (over + 1)));
+		// mov al, [rbx + r]; mov [rbx + a], al; mov byte [rbx + b], 1; mov byte [rbx + carry], 0
+		EmitRbx(0x8a, 0, Register8Offset(dst));
+		EmitRbx(0x88, 0, flags + offsetof(Z80::PendingFlags, a));
+		EmitRbx(0xc6, 0, flags + offsetof(Z80::PendingFlags, b));
+		Emit8(0x01);
+		EmitRbx(0xc6, 0, flags + offsetof(Z80::PendingFlags, carry));
+		Emit8(0x00);
+		// inc al / dec al; mov [rbx + result], al; mov [rbx + r], al
+		Emit8(0xfe);
+		Emit8(src == 4 ? 0xc0 : 0xc8);
+		EmitRbx(0x88, 0, flags + offsetof(Z80::PendingFlags, result));
+		EmitRbx(0x88, 0, Register8Offset(dst));
+		// mov dword [rbx + op], INC/DEC; mov byte [rbx + flags_pending], 1
+		EmitRbx(0xc7, 0, flags + offsetof(Z80::PendingFlags, op));
+		Emit32((uint32_t) (src == 4 ? Z80::FlagOp::INC : Z80::FlagOp::DEC));
+		EmitRbx(0xc6, 0, flags_pending_offset);
+		Emit8(0x01);
+		return true;
+	}
+#endif
+	return false;
+}
+
+bool JIT::TranslateBranch(Z80 &cpu, const Z80::MicroOp &op, uint32_t cycles)
+{
+	if(op.prefixed)
+	{
+		return false;
+	}
+	uint8_t opcode = op.opcode;
+	// Condition code, -1 for an unconditional jump.
+	int cc = -1;
+	uint16_t target;
+	uint16_t next;
+	uint32_t taken;
+	uint32_t not_taken;
+	switch(opcode)
+	{
+	case 0x20: case 0x28: case 0x30: case 0x38:
+		cc = (opcode >> 3) & 0x03;
+		// fall through
+	case 0x18:
+		target = op.pc + 1 + (int8_t) cpu.ReadMem(op.pc);
+		next = op.pc + 1;
+		taken = 12;
+		not_taken = 8;
+		break;
+	case 0xc2: case 0xca: case 0xd2: case 0xda:
+		cc = (opcode >> 3) & 0x03;
+		// fall through
+	case 0xc3:
+		target = cpu.ReadMem(op.pc) | (cpu.ReadMem(op.pc + 1) << 8);
+		next = op.pc + 2;
+		taken = 16;
+		not_taken = 12;
+		break;
+	case 0xe9:
+		// JP (HL): mov ax, [rbx + hl]; mov [rbx + pc], ax; mov eax, cycles
+		Emit8(0x66);
+		EmitRbx(0x8b, 0, registers_offset + 2 * HL);
+		Emit8(0x66);
+		EmitRbx(0x89, 0, pc_offset);
+		Emit8(0xb8);
+		Emit32(cycles + 4);
+		return true;
+	default:
+		return false;
+	}
+	size_t over = 0;
+	if(cc >= 0)
+	{
+		// test al, al; mov word [rbx + pc], next; mov eax, cycles; jz/jnz over the taken side
+		EmitFlag((uint8_t) cc);
+		Emit8(0x84);
+		Emit8(0xc0);
+		Emit8(0x66);
+		EmitRbx(0xc7, 0, pc_offset);
+		Emit16(next);
+		Emit8(0xb8);
+		Emit32(cycles + not_taken);
+		Emit8(cc & 1 ? 0x74 : 0x75);
+		over = code.size();
+		Emit8(0x00);
+	}
+	// mov word [rbx + pc], target; mov eax, cycles
+	Emit8(0x66);
+	EmitRbx(0xc7, 0, pc_offset);
+	Emit16(target);
+	Emit8(0xb8);
+	Emit32(cycles + taken);
+	if(cc >= 0)
+	{
+		Patch8(over, (uint8_t) (code.size() - (over + 1)));
+	}
+	return true;
+}
+
+void JIT::TranslateCall(const Z80::MicroOp &op)
+{
+	// mov word [rbx + pc], op.pc
+	Emit8(0x66);
+	EmitRbx(0xc7, 0, pc_offset);
+	Emit16(op.pc);
+	// mov <first argument>, rbx
+	Emit8(0x48);
+	Emit8(0x89);
+#if defined(_WIN32)
+	Emit8(0xd9);
+#else
+	Emit8(0xdf);
+#endif
+	// mov rax, handler; call rax
+	Emit8(0x48);
+	Emit8(0xb8);
+	Emit64((uint64_t) op.handler);
+	Emit8(0xff);
+	Emit8(0xd0);
+}
+
+void JIT::EmitLoadHL()
+{
+	// movzx eax, word [rbx + hl]; movzx ecx, ah
+	Emit8(0x0f);
+	EmitRbx(0xb7, 0, registers_offset + 2 * HL);
+	Emit8(0x0f);
+	Emit8(0xb6);
+	Emit8(0xcc);
+	// mov rdx, [rbx + rcx * 8 + read_pages]; test rdx, rdx; jz slow
+	Emit8(0x48);
+	Emit8(0x8b);
+	Emit8(0x94);
+	Emit8(0xcb);
+	Emit32(read_pages_offset);
+	Emit8(0x48);
+	Emit8(0x85);
+	Emit8(0xd2);
+	Emit8(0x0f);
+	Emit8(0x84);
+	slow_jump = code.size();
+	Emit32(0);
+	// movzx eax, al; mov cl, [rdx + rax]
+	Emit8(0x0f);
+	Emit8(0xb6);
+	Emit8(0xc0);
+	Emit8(0x8a);
+	Emit8(0x0c);
+	Emit8(0x02);
+}
+
+void JIT::EmitStoreHL(uint8_t src, uint8_t n)
+{
+	// movzx eax, word [rbx + hl]; movzx ecx, ah
+	Emit8(0x0f);
+	EmitRbx(0xb7, 0, registers_offset + 2 * HL);
+	Emit8(0x0f);
+	Emit8(0xb6);
+	Emit8(0xcc);
+	// mov rdx, [rbx + rcx * 8 + write_pages]; test rdx, rdx; jz slow
+	Emit8(0x48);
+	Emit8(0x8b);
+	Emit8(0x94);
+	Emit8(0xcb);
+	Emit32(write_pages_offset);
+	Emit8(0x48);
+	Emit8(0x85);
+	Emit8(0xd2);
+	Emit8(0x0f);
+	Emit8(0x84);
+	slow_jump = code.size();
+	Emit32(0);
+	// movzx eax, al; mov cl, n or [rbx + src]; mov [rdx + rax], cl
+	Emit8(0x0f);
+	Emit8(0xb6);
+	Emit8(0xc0);
+	if(src == 6)
+	{
+		Emit8(0xb1);
+		Emit8(n);
+	}
+	else
+	{
+		EmitRbx(0x8a, 1, Register8Offset(src));
+	}
+	Emit8(0x88);
+	Emit8(0x0c);
+	Emit8(0x02);
+}
+
+void JIT::EmitFlag(uint8_t cc)
+{
+	bool z = cc < 2;
+#if Z80_LAZY_FLAGS
+	// cmp byte [rbx + flags_pending], 0; je from_f
+	int32_t flags = pending_flags_offset;
+	EmitRbx(0x80, 7, flags_pending_offset);
+	Emit8(0x00);
+	Emit8(0x74);
+	size_t from_f = code.size();
+	Emit8(0x00);
+	if(z)
+	{
+		// cmp byte [rbx + result], 0; sete al
+		EmitRbx(0x80, 7, flags + offsetof(Z80::PendingFlags, result));
+		Emit8(0x00);
+		Emit8(0x0f);
+		Emit8(0x94);
+		Emit8(0xc0);
+	}
+	else
+	{
+		// mov al, [rbx + c]
+		EmitRbx(0x8a, 0, flags + offsetof(Z80::PendingFlags, c));
+	}
+	// jmp done
+	Emit8(0xeb);
+	size_t done = code.size();
+	Emit8(0x00);
+	Patch8(from_f, (uint8_t) (code.size() - (from_f + 1)));
+#endif
+	// test byte [rbx + f], flag; setnz al
+	EmitRbx(0xf6, 0, registers_offset + 2 * AF);
+	Emit8(1 << ((z ? FLAG_Z : FLAG_C) + 4));
+	Emit8(0x0f);
+	Emit8(0x95);
+	Emit8(0xc0);
+#if Z80_LAZY_FLAGS
+	Patch8(done, (uint8_t) (code.size() - (done + 1)));
+#endif
+}
+
+void JIT::EmitALU(uint8_t operation)
+{
+	static_assert(sizeof(Z80::FlagOp) == 4, "the pending FlagOp is stored as a dword");
+	// ADD, -, SUB, -, AND, XOR, OR, CP as <op> al, cl and the flags they leave pending.
+	static const uint8_t OPCODES[8] = {0x00, 0x00, 0x28, 0x00, 0x20, 0x30, 0x08, 0x28};
+	static const Z80::FlagOp FLAG_OPS[8] = {Z80::FlagOp::ADD, Z80::FlagOp::ADD, Z80::FlagOp::SUB, Z80::FlagOp::SUB,
+		Z80::FlagOp::AND, Z80::FlagOp::OR, Z80::FlagOp::OR, Z80::FlagOp::SUB};
+	bool carry = operation == 0 || operation == 2 || operation == 7;
+	int32_t flags = pending_flags_offset;
+	// mov al, [rbx + a]; mov [rbx + pending a], al; mov [rbx + pending b], cl; mov byte [rbx + carry], 0
+	EmitRbx(0x8a, 0, Register8Offset(7));
+	EmitRbx(0x88, 0, flags + offsetof(Z80::PendingFlags, a));
+	EmitRbx(0x88, 1, flags + offsetof(Z80::PendingFlags, b));
+	EmitRbx(0xc6, 0, flags + offsetof(Z80::PendingFlags, carry));
+	Emit8(0x00);
+	Emit8(OPCODES[operation]);
+	Emit8(0xc8);
+	if(carry)
+	{
+		// setc byte [rbx + c]
+		Emit8(0x0f);
+		EmitRbx(0x92, 0, flags + offsetof(Z80::PendingFlags, c));
+	}
+	else
+	{
+		// mov byte [rbx + c], 0
+		EmitRbx(0xc6, 0, flags + offsetof(Z80::PendingFlags, c));
+		Emit8(0x00);
+	}
+	// mov [rbx + result], al; mov [rbx + a], al but for CP
+	EmitRbx(0x88, 0, flags + offsetof(Z80::PendingFlags, result));
+	if(operation != 7)
+	{
+		EmitRbx(0x88, 0, Register8Offset(7));
+	}
+	// mov dword [rbx + op], FlagOp; mov byte [rbx + flags_pending], 1
+	EmitRbx(0xc7, 0, flags + offsetof(Z80::PendingFlags, op));
+	Emit32((uint32_t) FLAG_OPS[operation]);
+	EmitRbx(0xc6, 0, flags_pending_offset);
+	Emit8(0x01);
+}
+
+void JIT::EmitRbx(uint8_t opcode, uint8_t reg, int32_t offset)
+{
+	Emit8(opcode);
+	Emit8(0x83 | (reg << 3));
+	Emit32((uint32_t) offset);
+}
+
+void JIT::Translate(Z80 &cpu, const Z80::Block &block)
+{
+	code.clear();
+	// push rbx; mov rbx, <first argument>
+	Emit8(0x53);
+	Emit8(0x48);
+	Emit8(0x89);
+#if defined(_WIN32)
+	Emit8(0xcb);
+	// sub rsp, 32 for the callee shadow space
+	Emit8(0x48);
+	Emit8(0x83);
+	Emit8(0xec);
+	Emit8(0x20);
+#else
+	Emit8(0xfb);
+#endif
+	// jne rel32 displacements to patch with their exit stub, and the cycles each stub returns.
+	std::vector<size_t> exits;
+	std::vector<uint32_t> exit_cycles;
+	// Handler calls of ops whose (HL) page was null: the jz to patch, the op, its cycles like
+	// exit_cycles and where the translated code goes on.
+	struct SlowPath
+	{
+		size_t jump;
+		size_t op;
+		uint32_t cycles;
+		size_t resume;
+	};
+	std::vector<SlowPath> slow_paths;
+	uint32_t cycles = 0;
+	for(size_t i = 0, size = block.ops.size(); i < size; i++)
+	{
+		const Z80::MicroOp &op = block.ops[i];
+		bool last = i + 1 == size;
+		cycles += op.cycles;
+		if(last && TranslateBranch(cpu, op, block.cycles))
+		{
+			break;
+		}
+		slow_jump = 0;
+		if(TranslateNative(cpu, op))
+		{
+			if(slow_jump != 0)
+			{
+				slow_paths.push_back({slow_jump, i, cycles, code.size()});
+			}
+			if(last)
+			{
+				// mov word [rbx + pc], <next instruction>; mov eax, cycles
+				uint8_t opcode = op.opcode;
+				Emit8(0x66);
+				EmitRbx(0xc7, 0, pc_offset);
+				Emit16(op.pc + ((opcode & 0xc7) == 0x06 || (opcode & 0xc7) == 0xc6 ? 1 : 0));
+				Emit8(0xb8);
+				Emit32(cycles);
+			}
+			continue;
+		}
+		TranslateCall(op);
+		if(last)
+		{
+			// movzx eax, al; add eax, cycles of the other instructions
+			Emit8(0x0f);
+			Emit8(0xb6);
+			Emit8(0xc0);
+			Emit8(0x05);
+			Emit32(block.cycles);
+			break;
+		}
+		// cmp byte [rbx + block_exit], 0; jne exit
+		EmitRbx(0x80, 7, block_exit_offset);
+		Emit8(0x00);
+		Emit8(0x0f);
+		Emit8(0x85);
+		exits.push_back(code.size());
+		exit_cycles.push_back(cycles);
+		Emit32(0);
+	}
+	size_t epilogue = code.size();
+#if defined(_WIN32)
+	// add rsp, 32
+	Emit8(0x48);
+	Emit8(0x83);
+	Emit8(0xc4);
+	Emit8(0x20);
+#endif
+	// pop rbx; ret
+	Emit8(0x5b);
+	Emit8(0xc3);
+	for(const SlowPath &slow : slow_paths)
+	{
+		Patch32(slow.jump, (uint32_t) (code.size() - (slow.jump + 4)));
+		TranslateCall(block.ops[slow.op]);
+		if(slow.op + 1 < block.ops.size())
+		{
+			// cmp byte [rbx + block_exit], 0; jne exit
+			EmitRbx(0x80, 7, block_exit_offset);
+			Emit8(0x00);
+			Emit8(0x0f);
+			Emit8(0x85);
+			exits.push_back(code.size());
+			exit_cycles.push_back(slow.cycles);
+			Emit32(0);
+		}
+		// jmp resume
+		Emit8(0xe9);
+		Emit32((uint32_t) (slow.resume - (code.size() + 4)));
+	}
+	for(size_t i = 0; i < exits.size(); i++)
+	{
+		Patch32(exits[i], (uint32_t) (code.size() - (exits[i] + 4)));
+		// mov eax, cycles; jmp epilogue
+		Emit8(0xb8);
+		Emit32(exit_cycles[i]);
+		Emit8(0xe9);
+		Emit32((uint32_t) (epilogue - (code.size() + 4)));
+	}
+}
+
+JIT::Snapshot JIT::Save(Z80 &cpu, uint32_t cycles)
+{
+	Snapshot snapshot{cpu.ppu, cpu.timer, cpu.scheduler, cpu.ppu_synced,
+		{cpu.registers[0], cpu.registers[1], cpu.registers[2], cpu.registers[3]}, cpu.sp, cpu.pc,
+		cpu.IME, cpu.ime_delay, cpu.halted, cpu.stopped, cpu.rom_bank, cpu.ram_bank, cpu.ram_enabled,
+		cpu.rom_ram_mode, cpu.code_dirty, cpu.block_exit, cycles,
+		std::vector<uint8_t>(cpu.memory, cpu.memory + sizeof(cpu.memory)),
+		std::vector<uint8_t>(cpu.sram->Data(), cpu.sram->Data() + cpu.sram->Size())};
+	return snapshot;
+}
+
+void JIT::Restore(Z80 &cpu, const Snapshot &snapshot)
+{
+	memcpy(cpu.registers, snapshot.registers, sizeof(snapshot.registers));
+	cpu.sp = snapshot.sp;
+	cpu.pc = snapshot.pc;
+	cpu.IME = snapshot.IME;
+	cpu.ime_delay = snapshot.ime_delay;
+	cpu.halted = snapshot.halted;
+	cpu.stopped = snapshot.stopped;
+	cpu.rom_bank = snapshot.rom_bank;
+	cpu.ram_bank = snapshot.ram_bank;
+	cpu.ram_enabled = snapshot.ram_enabled;
+	cpu.rom_ram_mode = snapshot.rom_ram_mode;
+	cpu.code_dirty = snapshot.code_dirty;
+	cpu.block_exit = snapshot.block_exit;
+	cpu.ppu = snapshot.ppu;
+	cpu.timer = snapshot.timer;
+	cpu.scheduler = snapshot.scheduler;
+	cpu.ppu_synced = snapshot.ppu_synced;
+	memcpy(cpu.memory, snapshot.memory.data(), sizeof(cpu.memory));
+	memcpy(cpu.sram->Data(), snapshot.ram.data(), snapshot.ram.size());
+	cpu.MapMemory();
+	cpu.UpdateInterrupts();
+}
+
+uint32_t JIT::Verify(Z80 &cpu, Z80::Block &block)
+{
+	if(scratch == nullptr)
+	{
+		scratch = AllocateExecutable(SCRATCH_SIZE);
+		if(scratch == nullptr)
+		{
+			cpu.jit_verify = false;
+			return cpu.RunBlock(block, UINT32_MAX);
+		}
+		FindOffsets(cpu);
+	}
+	// Pending flags are compared through F.
+	cpu.FlushFlags();
+	uint32_t cycles = 0;
+	Z80::Block single;
+	single.cycles = 0;
+	for(const Z80::MicroOp &op : block.ops)
+	{
+		single.ops.assign(1, op);
+		Translate(cpu, single);
+		bool copied = Protect(scratch, SCRATCH_SIZE, false);
+		if(copied)
+		{
+			memcpy(scratch, code.data(), code.size());
+			copied = Protect(scratch, SCRATCH_SIZE, true);
+		}
+		Snapshot before = Save(cpu, 0);
+		uint32_t translated = 0;
+		if(copied)
+		{
+			translated = ((Z80::JitCode) scratch)(&cpu);
+			cpu.FlushFlags();
+		}
+		else
+		{
+			// Only the interpreter runs from here on.
+			std::cout << "ERROR:JIT::PROTECT\n";
+			cpu.jit_verify = false;
+		}
+		Snapshot jit = Save(cpu, translated);
+		Restore(cpu, before);
+		uint16_t addr = op.pc - (op.prefixed ? 2 : 1);
+		cpu.pc = addr;
+		uint8_t opcode = cpu.Fetch();
+		uint32_t interpreted = cpu.Dispatch(opcode);
+		cpu.FlushFlags();
+		Snapshot interpreter = Save(cpu, interpreted);
+		if(copied && (memcmp(jit.registers, interpreter.registers, sizeof(jit.registers)) != 0 || jit.sp != interpreter.sp ||
+			jit.pc != interpreter.pc || jit.IME != interpreter.IME || jit.ime_delay != interpreter.ime_delay ||
+			jit.halted != interpreter.halted || jit.stopped != interpreter.stopped || jit.rom_bank != interpreter.rom_bank ||
+			jit.ram_bank != interpreter.ram_bank || jit.ram_enabled != interpreter.ram_enabled ||
+			jit.rom_ram_mode != interpreter.rom_ram_mode || jit.code_dirty != interpreter.code_dirty ||
+			jit.block_exit != interpreter.block_exit || jit.cycles != interpreter.cycles ||
+			jit.memory != interpreter.memory || jit.ram != interpreter.ram))
+		{
+			std::cout << std::hex << "ERROR:JIT::VERIFY pc=" << addr << " opcode=" << (int) opcode
+				<< " jit(af=" << jit.registers[AF] << " bc=" << jit.registers[BC] << " de=" << jit.registers[DE]
+				<< " hl=" << jit.registers[HL] << " sp=" << jit.sp << " pc=" << jit.pc << " cycles=" << jit.cycles
+				<< ") interpreter(af=" << interpreter.registers[AF] << " bc=" << interpreter.registers[BC]
+				<< " de=" << interpreter.registers[DE] << " hl=" << interpreter.registers[HL] << " sp=" << interpreter.sp
+				<< " pc=" << interpreter.pc << " cycles=" << interpreter.cycles << ")\n" << std::dec;
+		}
+		cycles += interpreted;
+		if(cpu.block_exit)
+		{
+			break;
+		}
+	}
+	return cycles;
+}
+
+void JIT::Emit8(uint8_t byte)
+{
+	code.push_back(byte);
+}
+
+void JIT::Emit16(uint16_t value)
+{
+	Emit8(value & 0xff);
+	Emit8(value >> 8);
+}
+
+void JIT::Emit32(uint32_t value)
+{
+	Emit16(value & 0xffff);
+	Emit16(value >> 16);
+}
+
+void JIT::Emit64(uint64_t value)
+{
+	Emit32(value & 0xffffffff);
+	Emit32(value >> 32);
+}
+
+void JIT::Patch8(size_t at, uint8_t value)
+{
+	code[at] = value;
+}
+
+void JIT::Patch32(size_t at, uint32_t value)
+{
+	for(int i = 0; i < 4; i++)
+	{
+		code[at + i] = (value >> (8 * i)) & 0xff;
+	}
+}
+
+#endif
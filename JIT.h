@@ -0,0 +1,140 @@
+/*
+	Copyright (c) 2020 Paul Espina
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include "Z80.h"
+
+#include <stdint.h>
+#include <vector>
+
+#if Z80_JIT
+
+/*
+	x86-64 translator for cached blocks.
+	Emitted as native instructions: NOP, LD r,r', LD r,n, INC rr, DEC rr, LD SP,HL, loads and stores
+	through (HL), ADD, SUB, AND, XOR, OR and CP of a register, n or (HL), INC r and DEC r with
+	Z80_LAZY_FLAGS, and JR, JP and their NZ, Z, NC and C forms ending a block. (HL) goes through the
+	page tables, a null page calls the handler like every other instruction: ADC, SBC, the 16-bit
+	arithmetic, rotates and CB opcodes, LDH, stack operations, calls and returns.
+	The arena is writable while code is copied into it and executable while it runs, never both.
+	The translated code returns the cycles of the block like Z80::ExecuteBlock.
+*/
+class JIT
+{
+public:
+	// Blocks are translated after running this many times in the interpreter.
+	static constexpr uint32_t HOT_THRESHOLD = 8;
+	JIT();
+	~JIT();
+	// Translates block, returns nullptr if the executable arena could not be allocated.
+	Z80::JitCode Compile(Z80 &cpu, const Z80::Block &block);
+	// Runs block one instruction at a time, each translated and interpreted from the same
+	// state, prints the first difference of every instruction and keeps the interpreter result.
+	uint32_t Verify(Z80 &cpu, Z80::Block &block);
+	// Translated code is valid while the block's jit_generation matches.
+	uint32_t Generation() const;
+private:
+	static constexpr size_t ARENA_SIZE = 8 * 1024 * 1024;
+	static constexpr size_t SCRATCH_SIZE = 4096;
+	// Granularity of Protect.
+	static constexpr size_t PAGE_SIZE = 4096;
+	// State an instruction can change, compared by Verify.
+	struct Snapshot
+	{
+		// Writes to the LCD and timer registers change the PPU, the timer and their deadlines, so they are put back too.
+		PPU ppu;
+		Timer timer;
+		Scheduler scheduler;
+		uint64_t ppu_synced;
+		uint16_t registers[4];
+		uint16_t sp;
+		uint16_t pc;
+		bool IME;
+		bool ime_delay;
+		bool halted;
+		bool stopped;
+		uint16_t rom_bank;
+		uint8_t ram_bank;
+		bool ram_enabled;
+		bool rom_ram_mode;
+		bool code_dirty;
+		bool block_exit;
+		uint32_t cycles;
+		std::vector<uint8_t> memory;
+		std::vector<uint8_t> ram;
+	};
+	uint8_t *arena;
+	size_t arena_used;
+	// Executable page Verify translates single instructions into.
+	uint8_t *scratch;
+	uint32_t generation;
+	std::vector<uint8_t> code;
+	// Offsets of the Z80 members the translated code addresses through rbx.
+	int32_t registers_offset;
+	int32_t sp_offset;
+	int32_t pc_offset;
+	int32_t block_exit_offset;
+	int32_t read_pages_offset;
+	int32_t write_pages_offset;
+	int32_t pending_flags_offset;
+	int32_t flags_pending_offset;
+	// jz rel32 to the handler call of an op whose (HL) page was null, set by TranslateNative.
+	size_t slow_jump;
+	// Allocates size bytes of code memory, writable until Protect makes it executable.
+	static uint8_t *AllocateExecutable(size_t size);
+	static void FreeExecutable(uint8_t *memory, size_t size);
+	// Makes the pages of size bytes at memory read-execute, or read-write to copy code into them.
+	static bool Protect(uint8_t *memory, size_t size, bool executable);
+	void FindOffsets(Z80 &cpu);
+	// Emits block into code.
+	void Translate(Z80 &cpu, const Z80::Block &block);
+	// Emits op natively, returns false if it has to call its handler.
+	bool TranslateNative(Z80 &cpu, const Z80::MicroOp &op);
+	// Emits the jump ending a block, setting pc and returning cycles plus its own cycles. Returns
+	// false if it has to call its handler.
+	bool TranslateBranch(Z80 &cpu, const Z80::MicroOp &op, uint32_t cycles);
+	// Emits the call of op's handler.
+	void TranslateCall(const Z80::MicroOp &op);
+	// Loads the byte at (HL) into cl through read_pages, sets slow_jump.
+	void EmitLoadHL();
+	// Stores register src, or n when src is 6, to (HL) through write_pages, sets slow_jump.
+	void EmitStoreHL(uint8_t src, uint8_t n);
+	// Leaves al 1 if the flag tested by condition code cc (NZ, Z, NC, C) is set, 0 otherwise.
+	void EmitFlag(uint8_t cc);
+	// ALU operation of opcode bits 3-5 on A and cl, with the pending flags.
+	void EmitALU(uint8_t operation);
+	// opcode with ModRM operand [rbx + offset], reg in the ModRM reg field.
+	void EmitRbx(uint8_t opcode, uint8_t reg, int32_t offset);
+	// Offset of the 8-bit register encoded in bits 0-2 of an opcode (B, C, D, E, H, L, -, A).
+	int32_t Register8Offset(uint8_t index);
+	void Emit8(uint8_t byte);
+	void Emit16(uint16_t value);
+	void Emit32(uint32_t value);
+	void Emit64(uint64_t value);
+	void Patch8(size_t at, uint8_t value);
+	void Patch32(size_t at, uint32_t value);
+	Snapshot Save(Z80 &cpu, uint32_t cycles);
+	void Restore(Z80 &cpu, const Snapshot &snapshot);
+};
+
+#endif
@@ -1,4 +1,17 @@
-int main()
-{
+#include "Benchmark.h"
+
+#include <cstring>
+#include <iostream>
 
-}
\ No newline at end of file
+int main(int argc, char *argv[])
+{
+	if(argc == 3 && strcmp(argv[1], "--bench") == 0)
+	{
+		if(!Benchmark::Run(argv[2]))
+		{
+			std::cout << "ERROR:MAIN::UNKNOWN_BENCHMARK\n";
+			return 1;
+		}
+	}
+	return 0;
+}
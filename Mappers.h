@@ -0,0 +1,154 @@
+/*
+	Copyright (c) 2020 Paul Espina
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include "Z80.h"
+
+/*
+	Cartridge mappers, the policies of Z80::WriteROM.
+	Write handles a write to the ROM area and only updates the banking state,
+	WriteROM remaps the pages that changed.
+*/
+
+// No mapper, writes to ROM are ignored.
+struct Z80::RomOnly
+{
+	static void Write(Z80 &, uint16_t, uint8_t)
+	{
+	}
+};
+
+// Up to 2 MiB of ROM and 32 KiB of RAM.
+struct Z80::MBC1
+{
+	static void Write(Z80 &cpu, uint16_t addr, uint8_t data)
+	{
+		if(addr < 0x2000)
+		{
+			cpu.ram_enabled = (data & 0x0f) == 0x0a;
+		}
+		else if(addr < 0x4000)
+		{
+			cpu.rom_bank = (cpu.rom_bank & 0x60) | (data & 0x1f);
+			if((cpu.rom_bank & 0x1f) == 0)
+			{
+				cpu.rom_bank++;
+			}
+		}
+		else if(addr < 0x6000)
+		{
+			if(cpu.rom_ram_mode)
+			{
+				cpu.ram_bank = data & 0x03;
+			}
+			else
+			{
+				cpu.rom_bank = (cpu.rom_bank & 0x1f) | ((data & 0x03) << 5);
+			}
+		}
+		else
+		{
+			cpu.rom_ram_mode = (data & 0x01) != 0;
+		}
+	}
+};
+
+// Up to 256 KiB of ROM, bit 8 of the address selects the register in 0x0000-0x3fff.
+struct Z80::MBC2
+{
+	static void Write(Z80 &cpu, uint16_t addr, uint8_t data)
+	{
+		if(addr >= 0x4000)
+		{
+			return;
+		}
+		if(addr & 0x0100)
+		{
+			cpu.rom_bank = data & 0x0f;
+			if(cpu.rom_bank == 0)
+			{
+				cpu.rom_bank = 1;
+			}
+		}
+		else
+		{
+			cpu.ram_enabled = (data & 0x0f) == 0x0a;
+		}
+	}
+};
+
+// Up to 2 MiB of ROM, 32 KiB of RAM and a real-time clock mapped over the RAM.
+struct Z80::MBC3
+{
+	static void Write(Z80 &cpu, uint16_t addr, uint8_t data)
+	{
+		if(addr < 0x2000)
+		{
+			cpu.ram_enabled = (data & 0x0f) == 0x0a;
+		}
+		else if(addr < 0x4000)
+		{
+			cpu.rom_bank = data & 0x7f;
+			if(cpu.rom_bank == 0)
+			{
+				cpu.rom_bank = 1;
+			}
+		}
+		else if(addr < 0x6000)
+		{
+			// RAM banks 0x00-0x03, clock registers 0x08-0x0c.
+			if(data < 0x04 || (data >= 0x08 && data <= 0x0c))
+			{
+				cpu.ram_bank = data;
+			}
+		}
+		else
+		{
+			cpu.rtc.Latch(data, cpu.Now());
+		}
+	}
+};
+
+// Up to 8 MiB of ROM with 9-bit banks, bank 0 can be mapped at 0x4000, and 128 KiB of RAM.
+struct Z80::MBC5
+{
+	static void Write(Z80 &cpu, uint16_t addr, uint8_t data)
+	{
+		if(addr < 0x2000)
+		{
+			cpu.ram_enabled = (data & 0x0f) == 0x0a;
+		}
+		else if(addr < 0x3000)
+		{
+			cpu.rom_bank = (cpu.rom_bank & 0x100) | data;
+		}
+		else if(addr < 0x4000)
+		{
+			cpu.rom_bank = (cpu.rom_bank & 0xff) | ((data & 0x01) << 8);
+		}
+		else if(addr < 0x6000)
+		{
+			cpu.ram_bank = data & 0x0f;
+		}
+	}
+};
@@ -0,0 +1,381 @@
+/*
+	Copyright (c) 2020 Paul Espina
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "PPU.h"
+#include "RenderThread.h"
+
+#include <algorithm>
+
+constexpr uint16_t LCDC = 0xff40;
+constexpr uint16_t STAT = 0xff41;
+constexpr uint16_t LY = 0xff44;
+constexpr uint16_t LYC = 0xff45;
+constexpr uint16_t IF = 0xff0f;
+
+constexpr uint8_t INTERRUPT_VBLANK = 0x01;
+constexpr uint8_t INTERRUPT_STAT = 0x02;
+
+PPU::PPU(uint8_t *memory, uint8_t (*screen)[WIDTH]) : renderer(memory, screen)
+{
+	this->memory = memory;
+	rendering = true;
+	rendering_next = true;
+	Reset();
+}
+
+void PPU::Reset()
+{
+	mode = Mode::OAM;
+	mode_cycles = OAM_CYCLES;
+	stat_line = false;
+	frames = 0;
+	rendering = rendering_next;
+	Register(LY) = 0;
+	Register(STAT) = (Register(STAT) & 0x78) | (uint8_t) Mode::OAM;
+	renderer.StartFrame();
+	renderer.DecodeTiles();
+	if(thread != nullptr)
+	{
+		// Memory may have been rewritten without the log, start over from it.
+		thread.reset();
+		thread = std::make_shared<RenderThread>(renderer, memory);
+	}
+}
+
+uint8_t &PPU::Register(uint16_t addr)
+{
+	return memory[addr];
+}
+
+uint32_t PPU::Frames() const
+{
+	return frames;
+}
+
+uint32_t PPU::CyclesToEvent() const
+{
+	if(!(memory[LCDC] & 0x80))
+	{
+		return NEVER;
+	}
+	return (uint32_t) mode_cycles;
+}
+
+uint32_t PPU::CyclesToInterrupt(uint8_t enabled) const
+{
+	if(!(memory[LCDC] & 0x80))
+	{
+		return NEVER;
+	}
+	uint32_t position = FramePosition();
+	uint8_t stat = (enabled & INTERRUPT_STAT) ? memory[STAT] : 0;
+	uint32_t cycles = NEVER;
+	if((enabled & INTERRUPT_VBLANK) || (stat & 0x10))
+	{
+		cycles = std::min(cycles, CyclesTo(position, HEIGHT * LINE_CYCLES));
+	}
+	if(stat & 0x08)
+	{
+		cycles = std::min(cycles, CyclesToLine(position, OAM_CYCLES + TRANSFER_CYCLES));
+	}
+	if(stat & 0x20)
+	{
+		cycles = std::min(cycles, CyclesToLine(position, 0));
+	}
+	if((stat & 0x40) && memory[LYC] < LINES)
+	{
+		cycles = std::min(cycles, CyclesTo(position, memory[LYC] * LINE_CYCLES));
+	}
+	return cycles;
+}
+
+uint32_t PPU::FramePosition() const
+{
+	uint32_t line = memory[LY] * LINE_CYCLES;
+	switch(mode)
+	{
+	case Mode::OAM:
+		return line + OAM_CYCLES - mode_cycles;
+	case Mode::TRANSFER:
+		return line + OAM_CYCLES + TRANSFER_CYCLES - mode_cycles;
+	default:
+		return line + LINE_CYCLES - mode_cycles;
+	}
+}
+
+uint32_t PPU::CyclesTo(uint32_t position, uint32_t at)
+{
+	return (at + FRAME_CYCLES - position - 1) % FRAME_CYCLES + 1;
+}
+
+uint32_t PPU::CyclesToLine(uint32_t position, uint32_t offset)
+{
+	uint32_t line = position / LINE_CYCLES;
+	if(position % LINE_CYCLES >= offset)
+	{
+		line++;
+	}
+	if(line >= HEIGHT)
+	{
+		return CyclesTo(position, offset);
+	}
+	return line * LINE_CYCLES + offset - position;
+}
+
+void PPU::Advance(uint32_t cycles)
+{
+	if(!(Register(LCDC) & 0x80))
+	{
+		return;
+	}
+	mode_cycles -= (int32_t) cycles;
+	while(mode_cycles <= 0)
+	{
+		uint8_t line = Register(LY);
+		switch(mode)
+		{
+		case Mode::OAM:
+			SetMode(Mode::TRANSFER);
+			mode_cycles += TRANSFER_CYCLES;
+			break;
+		case Mode::TRANSFER:
+			RenderLine(line);
+			SetMode(Mode::HBLANK);
+			mode_cycles += HBLANK_CYCLES;
+			break;
+		case Mode::HBLANK:
+			SetLine(line + 1);
+			if(line + 1 == HEIGHT)
+			{
+				frames++;
+				RequestInterrupt(INTERRUPT_VBLANK);
+				SetMode(Mode::VBLANK);
+				mode_cycles += LINE_CYCLES;
+			}
+			else
+			{
+				SetMode(Mode::OAM);
+				mode_cycles += OAM_CYCLES;
+			}
+			break;
+		case Mode::VBLANK:
+			if(line + 1 == LINES)
+			{
+				StartFrame();
+				SetMode(Mode::OAM);
+				mode_cycles += OAM_CYCLES;
+			}
+			else
+			{
+				SetLine(line + 1);
+				mode_cycles += LINE_CYCLES;
+			}
+			break;
+		}
+	}
+}
+
+void PPU::SetRendering(bool enabled)
+{
+	rendering_next = enabled;
+}
+
+void PPU::SetThreaded(bool enabled)
+{
+	if(enabled && thread == nullptr)
+	{
+		thread = std::make_shared<RenderThread>(renderer, memory);
+	}
+	else if(!enabled && thread != nullptr)
+	{
+		thread->Sync();
+		renderer = Renderer(thread->State(), memory);
+		thread.reset();
+	}
+}
+
+bool PPU::Threaded() const
+{
+	return thread != nullptr;
+}
+
+void PPU::Sync()
+{
+	if(thread != nullptr)
+	{
+		thread->Sync();
+	}
+}
+
+Renderer::Damage PPU::LastDamage() const
+{
+	return thread != nullptr ? thread->State().LastDamage() : renderer.LastDamage();
+}
+
+void PPU::SetOutput(void *pixels, size_t pitch, PixelFormat format)
+{
+	renderer.SetOutput(pixels, pitch, format);
+	if(thread != nullptr)
+	{
+		thread->SetOutput(pixels, pitch, format);
+	}
+}
+
+void PPU::WriteVRAM(uint16_t addr, uint8_t data)
+{
+	renderer.WriteVRAM(addr, data);
+	if(thread != nullptr)
+	{
+		thread->Write(addr, data);
+	}
+}
+
+void PPU::WriteOAM(uint16_t addr, uint8_t data)
+{
+	memory[addr] = data;
+	if(thread != nullptr)
+	{
+		thread->Write(addr, data);
+	}
+}
+
+void PPU::WriteRegister(uint16_t addr, uint8_t data)
+{
+	// The registers drawing reads keep the value written.
+	if(thread != nullptr)
+	{
+		thread->Write(addr, data);
+	}
+	switch(addr)
+	{
+	case LCDC:
+		if((data ^ Register(LCDC)) & 0x80)
+		{
+			Register(LCDC) = data;
+			// Switching the LCD off or on restarts it at line 0.
+			mode = data & 0x80 ? Mode::OAM : Mode::HBLANK;
+			mode_cycles = OAM_CYCLES;
+			Register(STAT) = (Register(STAT) & 0xfc) | (uint8_t) mode;
+			StartFrame();
+			return;
+		}
+		Register(LCDC) = data;
+		return;
+	case STAT:
+		Register(STAT) = (data & 0x78) | (Register(STAT) & 0x07);
+		UpdateStat();
+		return;
+	case LY:
+		return;
+	case LYC:
+		Register(LYC) = data;
+		SetLine(Register(LY));
+		return;
+	default:
+		Register(addr) = data;
+	}
+}
+
+void PPU::StartFrame()
+{
+	rendering = rendering_next;
+	if(thread != nullptr)
+	{
+		thread->StartFrame();
+	}
+	else
+	{
+		renderer.StartFrame();
+	}
+	SetLine(0);
+}
+
+void PPU::RenderLine(uint8_t line)
+{
+	// Drawing only changes screen and the window's line, which starts over with the next frame.
+	if(!rendering)
+	{
+		return;
+	}
+	if(thread != nullptr)
+	{
+		thread->RenderLine(line);
+	}
+	else
+	{
+		renderer.RenderLine(line);
+	}
+}
+
+void PPU::SetMode(Mode next)
+{
+	mode = next;
+	Register(STAT) = (Register(STAT) & 0xfc) | (uint8_t) next;
+	UpdateStat();
+}
+
+void PPU::SetLine(uint8_t line)
+{
+	Register(LY) = line;
+	if(line == Register(LYC))
+	{
+		Register(STAT) |= 0x04;
+	}
+	else
+	{
+		Register(STAT) &= ~0x04;
+	}
+	UpdateStat();
+}
+
+void PPU::UpdateStat()
+{
+	uint8_t stat = Register(STAT);
+	bool line = (stat & 0x44) == 0x44;
+	if(Register(LCDC) & 0x80)
+	{
+		switch(mode)
+		{
+		case Mode::HBLANK:
+			line |= (stat & 0x08) != 0;
+			break;
+		case Mode::VBLANK:
+			line |= (stat & 0x10) != 0;
+			break;
+		case Mode::OAM:
+			line |= (stat & 0x20) != 0;
+			break;
+		default:
+			break;
+		}
+	}
+	if(line && !stat_line)
+	{
+		RequestInterrupt(INTERRUPT_STAT);
+	}
+	stat_line = line;
+}
+
+void PPU::RequestInterrupt(uint8_t bit)
+{
+	Register(IF) |= bit;
+}
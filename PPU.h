@@ -0,0 +1,114 @@
+/*
+	Copyright (c) 2020 Paul Espina
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include "Renderer.h"
+
+#include <stdint.h>
+#include <memory>
+
+class RenderThread;
+
+/*
+	Scanline PPU.
+	Mode timing, LY, STAT and the LCD interrupts are exact to the T-state passed to
+	Advance, pixels are produced a whole line at a time when the line leaves mode 3,
+	by the Renderer in line or by a RenderThread.
+	VRAM, OAM and the registers at 0xff40-0xff4b are read from the CPU's memory.
+*/
+class PPU
+{
+public:
+	static constexpr uint32_t LINE_CYCLES = 456;
+	static constexpr int LINES = 154;
+	static constexpr int WIDTH = Renderer::WIDTH;
+	static constexpr int HEIGHT = Renderer::HEIGHT;
+	static constexpr int TILES = Renderer::TILES;
+	static constexpr uint32_t NEVER = UINT32_MAX;
+	// memory is the 64 KiB address space, screen receives shades 0-3 after the palettes.
+	PPU(uint8_t *memory, uint8_t (*screen)[WIDTH]);
+	// State after the boot ROM, start of line 0.
+	void Reset();
+	// Runs the PPU for cycles T-states.
+	void Advance(uint32_t cycles);
+	// T-states until the next mode change, the PPU is idle until then. NEVER while the LCD is off.
+	uint32_t CyclesToEvent() const;
+	// T-states until the PPU may next request one of the interrupts set in enabled, a mask like
+	// IE, NEVER if it cannot. Never later than the request, earlier when STAT sources overlap.
+	uint32_t CyclesToInterrupt(uint8_t enabled) const;
+	// Write to VRAM at 0x8000-0x9fff. Writes to tile data have to go through here, writes to
+	// the tile maps too while Threaded.
+	void WriteVRAM(uint16_t addr, uint8_t data);
+	// Write to OAM at 0xfe00-0xfe9f, all of them have to go through here while Threaded.
+	void WriteOAM(uint16_t addr, uint8_t data);
+	// Write to 0xff40-0xff4b except DMA.
+	void WriteRegister(uint16_t addr, uint8_t data);
+	// Switches drawing into screen on or off from the next frame, LY, STAT and the
+	// LCD interrupts keep the same timing either way.
+	void SetRendering(bool enabled);
+	// Moves drawing to a RenderThread and back. screen is only up to date after Sync.
+	void SetThreaded(bool enabled);
+	bool Threaded() const;
+	// Waits for the render thread to draw every line run so far.
+	void Sync();
+	// Renderer::LastDamage of whichever renderer draws, after Sync.
+	Renderer::Damage LastDamage() const;
+	// Renderer::SetOutput, on the render thread too.
+	void SetOutput(void *pixels, size_t pitch, PixelFormat format);
+	// Frames completed, incremented on entering VBlank.
+	uint32_t Frames() const;
+private:
+	enum class Mode{HBLANK = 0, VBLANK = 1, OAM = 2, TRANSFER = 3};
+	static constexpr uint32_t OAM_CYCLES = 80;
+	static constexpr uint32_t TRANSFER_CYCLES = 172;
+	static constexpr uint32_t HBLANK_CYCLES = LINE_CYCLES - OAM_CYCLES - TRANSFER_CYCLES;
+	static constexpr uint32_t FRAME_CYCLES = LINE_CYCLES * LINES;
+	uint8_t *memory;
+	Renderer renderer;
+	// Draws instead of renderer while Threaded, shared by copies of the PPU.
+	std::shared_ptr<RenderThread> thread;
+	Mode mode;
+	// Cycles until the current mode ends.
+	int32_t mode_cycles;
+	// Level of the STAT interrupt line, the interrupt is requested on a rising edge.
+	bool stat_line;
+	uint32_t frames;
+	// Whether this frame is drawn, and the next one from SetRendering.
+	bool rendering;
+	bool rendering_next;
+	uint8_t &Register(uint16_t addr);
+	// T-states since the start of the frame.
+	uint32_t FramePosition() const;
+	// T-states from position to the next time the frame reaches at, a whole frame if it is there.
+	static uint32_t CyclesTo(uint32_t position, uint32_t at);
+	// T-states from position to the next visible line reaching offset into the line.
+	static uint32_t CyclesToLine(uint32_t position, uint32_t offset);
+	void SetMode(Mode next);
+	// Starts line LY, compares it to LYC.
+	void SetLine(uint8_t line);
+	void UpdateStat();
+	void RequestInterrupt(uint8_t bit);
+	// Starts a frame at line 0.
+	void StartFrame();
+	void RenderLine(uint8_t line);
+};
@@ -0,0 +1,389 @@
+/*
+	Copyright (c) 2020 Paul Espina
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "Pixels.h"
+
+#include <cstring>
+
+#if PIXELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define PIXELS_AVX2
+#else
+#define PIXELS_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+static void DecodeScalar(const uint8_t *planes, uint8_t *colors, int rows)
+{
+	for(int row = 0; row < rows; row++, planes += 2, colors += 8)
+	{
+		uint8_t lo = planes[0];
+		uint8_t hi = planes[1];
+		for(int x = 0; x < 8; x++)
+		{
+			int bit = 7 - x;
+			colors[x] = ((lo >> bit) & 1) | (((hi >> bit) & 1) << 1);
+		}
+	}
+}
+
+static void PaletteScalar(const uint8_t *colors, uint8_t palette, uint8_t *shades, int count)
+{
+	for(int i = 0; i < count; i++)
+	{
+		shades[i] = (palette >> (colors[i] * 2)) & 0x03;
+	}
+}
+
+static void CompositeScalar(const uint8_t *colors, const uint8_t *sprites, uint8_t obp0, uint8_t obp1, uint8_t *pixels, int count)
+{
+	for(int i = 0; i < count; i++)
+	{
+		uint8_t sprite = sprites[i];
+		uint8_t color = sprite & 0x03;
+		if(color == 0 || ((sprite & Pixels::SPRITE_BEHIND) && colors[i] != 0))
+		{
+			continue;
+		}
+		uint8_t palette = sprite & Pixels::SPRITE_PALETTE ? obp1 : obp0;
+		pixels[i] = (palette >> (color * 2)) & 0x03;
+	}
+}
+
+static void ExpandScalar(const uint8_t *shades, const uint32_t *table, int size, void *out, int count)
+{
+	// Local copy, the stores to out could alias table.
+	uint32_t values[4] = {table[0], table[1], table[2], table[3]};
+	switch(size)
+	{
+	case 1:
+		for(int i = 0; i < count; i++)
+		{
+			static_cast<uint8_t *>(out)[i] = (uint8_t) values[shades[i]];
+		}
+		break;
+	case 2:
+		for(int i = 0; i < count; i++)
+		{
+			static_cast<uint16_t *>(out)[i] = (uint16_t) values[shades[i]];
+		}
+		break;
+	default:
+		for(int i = 0; i < count; i++)
+		{
+			static_cast<uint32_t *>(out)[i] = values[shades[i]];
+		}
+		break;
+	}
+}
+
+#if PIXELS_X86
+
+// Broadcasts a byte to the 8 bytes of a 64-bit lane.
+static int64_t Spread(uint8_t byte)
+{
+	return (int64_t) (byte * 0x0101010101010101ull);
+}
+
+// Shade of each color index of a palette in all lanes.
+struct ShadesSSE2
+{
+	__m128i shades[4];
+	explicit ShadesSSE2(uint8_t palette)
+	{
+		for(int color = 0; color < 4; color++)
+		{
+			shades[color] = _mm_set1_epi8((char) ((palette >> (color * 2)) & 0x03));
+		}
+	}
+	__m128i Lookup(__m128i colors) const
+	{
+		__m128i result = shades[0];
+		for(int color = 1; color < 4; color++)
+		{
+			__m128i match = _mm_cmpeq_epi8(colors, _mm_set1_epi8((char) color));
+			result = _mm_or_si128(_mm_and_si128(match, shades[color]), _mm_andnot_si128(match, result));
+		}
+		return result;
+	}
+};
+
+static void DecodeSSE2(const uint8_t *planes, uint8_t *colors, int rows)
+{
+	// Lane x tests bit 7 - x of its row.
+	const __m128i bits = _mm_set_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char) 0x80,
+		0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char) 0x80);
+	const __m128i one = _mm_set1_epi8(1);
+	const __m128i two = _mm_set1_epi8(2);
+	int row = 0;
+	for(; row + 2 <= rows; row += 2, planes += 4, colors += 16)
+	{
+		__m128i lo = _mm_set_epi64x(Spread(planes[2]), Spread(planes[0]));
+		__m128i hi = _mm_set_epi64x(Spread(planes[3]), Spread(planes[1]));
+		lo = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(lo, bits), bits), one);
+		hi = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(hi, bits), bits), two);
+		_mm_storeu_si128((__m128i *) colors, _mm_or_si128(lo, hi));
+	}
+	DecodeScalar(planes, colors, rows - row);
+}
+
+static void PaletteSSE2(const uint8_t *colors, uint8_t palette, uint8_t *shades, int count)
+{
+	const ShadesSSE2 table(palette);
+	int i = 0;
+	for(; i + 16 <= count; i += 16)
+	{
+		__m128i indices = _mm_loadu_si128((const __m128i *) &colors[i]);
+		_mm_storeu_si128((__m128i *) &shades[i], table.Lookup(indices));
+	}
+	PaletteScalar(colors + i, palette, shades + i, count - i);
+}
+
+static void CompositeSSE2(const uint8_t *colors, const uint8_t *sprites, uint8_t obp0, uint8_t obp1, uint8_t *pixels, int count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i index = _mm_set1_epi8(0x03);
+	const __m128i select = _mm_set1_epi8(Pixels::SPRITE_PALETTE);
+	const __m128i behind = _mm_set1_epi8((char) Pixels::SPRITE_BEHIND);
+	const ShadesSSE2 table0(obp0);
+	const ShadesSSE2 table1(obp1);
+	int i = 0;
+	for(; i + 16 <= count; i += 16)
+	{
+		__m128i sprite = _mm_loadu_si128((const __m128i *) &sprites[i]);
+		__m128i background = _mm_loadu_si128((const __m128i *) &colors[i]);
+		__m128i pixel = _mm_loadu_si128((const __m128i *) &pixels[i]);
+		__m128i color = _mm_and_si128(sprite, index);
+		__m128i transparent = _mm_cmpeq_epi8(color, zero);
+		__m128i hidden = _mm_andnot_si128(_mm_cmpeq_epi8(background, zero),
+			_mm_cmpeq_epi8(_mm_and_si128(sprite, behind), behind));
+		__m128i keep = _mm_or_si128(transparent, hidden);
+		__m128i obp1_lanes = _mm_cmpeq_epi8(_mm_and_si128(sprite, select), select);
+		__m128i shade = _mm_or_si128(_mm_and_si128(obp1_lanes, table1.Lookup(color)),
+			_mm_andnot_si128(obp1_lanes, table0.Lookup(color)));
+		pixel = _mm_or_si128(_mm_and_si128(keep, pixel), _mm_andnot_si128(keep, shade));
+		_mm_storeu_si128((__m128i *) &pixels[i], pixel);
+	}
+	CompositeScalar(colors + i, sprites + i, obp0, obp1, pixels + i, count - i);
+}
+
+static void ExpandSSE2(const uint8_t *shades, const uint32_t *table, int size, void *out, int count)
+{
+	// Four pixels per vector is no faster than the scalar table for 32-bit pixels.
+	const __m128i zero = _mm_setzero_si128();
+	int i = 0;
+	if(size == 1)
+	{
+		ShadesSSE2 lookup(0);
+		for(int shade = 0; shade < 4; shade++)
+		{
+			lookup.shades[shade] = _mm_set1_epi8((char) table[shade]);
+		}
+		for(; i + 16 <= count; i += 16)
+		{
+			__m128i indices = _mm_loadu_si128((const __m128i *) &shades[i]);
+			_mm_storeu_si128((__m128i *) &static_cast<uint8_t *>(out)[i], lookup.Lookup(indices));
+		}
+	}
+	else if(size == 2)
+	{
+		__m128i values[4];
+		for(int shade = 0; shade < 4; shade++)
+		{
+			values[shade] = _mm_set1_epi16((short) table[shade]);
+		}
+		for(; i + 8 <= count; i += 8)
+		{
+			__m128i indices = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) &shades[i]), zero);
+			__m128i result = values[0];
+			for(int shade = 1; shade < 4; shade++)
+			{
+				__m128i match = _mm_cmpeq_epi16(indices, _mm_set1_epi16((short) shade));
+				result = _mm_or_si128(_mm_and_si128(match, values[shade]), _mm_andnot_si128(match, result));
+			}
+			_mm_storeu_si128((__m128i *) &static_cast<uint16_t *>(out)[i], result);
+		}
+	}
+	ExpandScalar(shades + i, table, size, static_cast<uint8_t *>(out) + i * size, count - i);
+}
+
+// Shuffle table of a palette, shade n in byte n of both 128-bit halves.
+PIXELS_AVX2 static __m256i TableAVX2(uint8_t palette)
+{
+	int32_t shades = (palette & 0x03) | ((palette >> 2) & 0x03) << 8 | ((palette >> 4) & 0x03) << 16 | ((palette >> 6) & 0x03) << 24;
+	return _mm256_set_epi32(0, 0, 0, shades, 0, 0, 0, shades);
+}
+
+PIXELS_AVX2 static void DecodeAVX2(const uint8_t *planes, uint8_t *colors, int rows)
+{
+	const __m256i bits = _mm256_set1_epi64x((int64_t) 0x0102040810204080ull);
+	const __m256i one = _mm256_set1_epi8(1);
+	const __m256i two = _mm256_set1_epi8(2);
+	int row = 0;
+	for(; row + 4 <= rows; row += 4, planes += 8, colors += 32)
+	{
+		__m256i lo = _mm256_set_epi64x(Spread(planes[6]), Spread(planes[4]), Spread(planes[2]), Spread(planes[0]));
+		__m256i hi = _mm256_set_epi64x(Spread(planes[7]), Spread(planes[5]), Spread(planes[3]), Spread(planes[1]));
+		lo = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(lo, bits), bits), one);
+		hi = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(hi, bits), bits), two);
+		_mm256_storeu_si256((__m256i *) colors, _mm256_or_si256(lo, hi));
+	}
+	// The SSE2 tail is not VEX encoded, mixing it with dirty upper halves is slow.
+	_mm256_zeroupper();
+	DecodeSSE2(planes, colors, rows - row);
+}
+
+PIXELS_AVX2 static void PaletteAVX2(const uint8_t *colors, uint8_t palette, uint8_t *shades, int count)
+{
+	const __m256i table = TableAVX2(palette);
+	int i = 0;
+	for(; i + 32 <= count; i += 32)
+	{
+		__m256i indices = _mm256_loadu_si256((const __m256i *) &colors[i]);
+		_mm256_storeu_si256((__m256i *) &shades[i], _mm256_shuffle_epi8(table, indices));
+	}
+	_mm256_zeroupper();
+	PaletteSSE2(colors + i, palette, shades + i, count - i);
+}
+
+PIXELS_AVX2 static void CompositeAVX2(const uint8_t *colors, const uint8_t *sprites, uint8_t obp0, uint8_t obp1, uint8_t *pixels, int count)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i index = _mm256_set1_epi8(0x03);
+	const __m256i select = _mm256_set1_epi8(Pixels::SPRITE_PALETTE);
+	const __m256i behind = _mm256_set1_epi8((char) Pixels::SPRITE_BEHIND);
+	const __m256i table0 = TableAVX2(obp0);
+	const __m256i table1 = TableAVX2(obp1);
+	int i = 0;
+	for(; i + 32 <= count; i += 32)
+	{
+		__m256i sprite = _mm256_loadu_si256((const __m256i *) &sprites[i]);
+		__m256i background = _mm256_loadu_si256((const __m256i *) &colors[i]);
+		__m256i pixel = _mm256_loadu_si256((const __m256i *) &pixels[i]);
+		__m256i color = _mm256_and_si256(sprite, index);
+		__m256i transparent = _mm256_cmpeq_epi8(color, zero);
+		__m256i hidden = _mm256_andnot_si256(_mm256_cmpeq_epi8(background, zero),
+			_mm256_cmpeq_epi8(_mm256_and_si256(sprite, behind), behind));
+		__m256i keep = _mm256_or_si256(transparent, hidden);
+		__m256i obp1_lanes = _mm256_cmpeq_epi8(_mm256_and_si256(sprite, select), select);
+		__m256i shade = _mm256_blendv_epi8(_mm256_shuffle_epi8(table0, color), _mm256_shuffle_epi8(table1, color), obp1_lanes);
+		_mm256_storeu_si256((__m256i *) &pixels[i], _mm256_blendv_epi8(shade, pixel, keep));
+	}
+	_mm256_zeroupper();
+	CompositeSSE2(colors + i, sprites + i, obp0, obp1, pixels + i, count - i);
+}
+
+PIXELS_AVX2 static void ExpandAVX2(const uint8_t *shades, const uint32_t *table, int size, void *out, int count)
+{
+	// Table entries in the low four 32-bit lanes, for permutevar8x32.
+	const __m256i values = _mm256_setr_epi32((int) table[0], (int) table[1], (int) table[2], (int) table[3], 0, 0, 0, 0);
+	int i = 0;
+	if(size == 1)
+	{
+		uint32_t bytes = (table[0] & 0xff) | (table[1] & 0xff) << 8 | (table[2] & 0xff) << 16 | (table[3] & 0xff) << 24;
+		const __m256i lookup = _mm256_set_epi32(0, 0, 0, (int) bytes, 0, 0, 0, (int) bytes);
+		for(; i + 32 <= count; i += 32)
+		{
+			__m256i indices = _mm256_loadu_si256((const __m256i *) &shades[i]);
+			_mm256_storeu_si256((__m256i *) &static_cast<uint8_t *>(out)[i], _mm256_shuffle_epi8(lookup, indices));
+		}
+	}
+	else if(size == 2)
+	{
+		// Only the low halves, so packus never saturates.
+		const __m256i halves = _mm256_and_si256(values, _mm256_set1_epi32(0xffff));
+		for(; i + 16 <= count; i += 16)
+		{
+			__m256i lo = _mm256_permutevar8x32_epi32(halves, _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) &shades[i])));
+			__m256i hi = _mm256_permutevar8x32_epi32(halves, _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) &shades[i + 8])));
+			// packus works within 128-bit halves, the permute puts the quarters back in order.
+			__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xd8);
+			_mm256_storeu_si256((__m256i *) &static_cast<uint16_t *>(out)[i], packed);
+		}
+	}
+	else
+	{
+		for(; i + 8 <= count; i += 8)
+		{
+			__m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) &shades[i]));
+			_mm256_storeu_si256((__m256i *) &static_cast<uint32_t *>(out)[i], _mm256_permutevar8x32_epi32(values, indices));
+		}
+	}
+	_mm256_zeroupper();
+	ExpandSSE2(shades + i, table, size, static_cast<uint8_t *>(out) + i * size, count - i);
+}
+
+#endif
+
+static const Pixels::Kernels KERNELS[] =
+{
+	{&DecodeScalar, &PaletteScalar, &CompositeScalar, &ExpandScalar},
+#if PIXELS_X86
+	{&DecodeSSE2, &PaletteSSE2, &CompositeSSE2, &ExpandSSE2},
+	{&DecodeAVX2, &PaletteAVX2, &CompositeAVX2, &ExpandAVX2},
+#endif
+};
+
+Pixels::Level Pixels::Supported()
+{
+#if PIXELS_X86
+	// SSE2 is part of x86-64, AVX2 also needs the OS to save the YMM registers.
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	bool avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 0x06) == 0x06;
+	__cpuidex(info, 7, 0);
+	return avx && (info[1] & (1 << 5)) ? Level::AVX2 : Level::SSE2;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") ? Level::AVX2 : Level::SSE2;
+#endif
+#else
+	return Level::SCALAR;
+#endif
+}
+
+const Pixels::Kernels &Pixels::Get(Level level)
+{
+	return KERNELS[(int) level];
+}
+
+const Pixels::Kernels &Pixels::Best()
+{
+	static const Kernels &best = Get(Supported());
+	return best;
+}
+
+const char *Pixels::Name(Level level)
+{
+	switch(level)
+	{
+	case Level::SSE2:
+		return "sse2";
+	case Level::AVX2:
+		return "avx2";
+	default:
+		return "scalar";
+	}
+}
@@ -0,0 +1,62 @@
+/*
+	Copyright (c) 2020 Paul Espina
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define PIXELS_X86 1
+#else
+#define PIXELS_X86 0
+#endif
+
+/*
+	Data-parallel steps of turning a line into pixels, in scalar, SSE2 and AVX2
+	versions with identical results. Best picks the widest the CPU supports.
+*/
+class Pixels
+{
+public:
+	enum class Level{SCALAR, SSE2, AVX2};
+	// Sprite line pixels, the color index in bits 0-1 (0 is transparent), OAM flag
+	// bit 4 selecting OBP1 and bit 7 putting the sprite behind background colors 1-3.
+	static constexpr uint8_t SPRITE_PALETTE = 0x10;
+	static constexpr uint8_t SPRITE_BEHIND = 0x80;
+	struct Kernels
+	{
+		// Expands rows of 2bpp tile data, low and high bitplane byte pairs, to 8 color indices each.
+		void (*decode)(const uint8_t *planes, uint8_t *colors, int rows);
+		// Maps color indices to shades through a BGP/OBP palette.
+		void (*palette)(const uint8_t *colors, uint8_t palette, uint8_t *shades, int count);
+		// Draws the opaque sprite pixels over pixels unless behind a nonzero background color.
+		void (*composite)(const uint8_t *colors, const uint8_t *sprites, uint8_t obp0, uint8_t obp1, uint8_t *pixels, int count);
+		// Writes table[shade] of each shade to out as size bytes, size is 1, 2 or 4.
+		void (*expand)(const uint8_t *shades, const uint32_t *table, int size, void *out, int count);
+	};
+	// Widest level the CPU supports.
+	static Level Supported();
+	// Kernels of level, which must not be above Supported.
+	static const Kernels &Get(Level level);
+	static const Kernels &Best();
+	static const char *Name(Level level);
+};
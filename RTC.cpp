@@ -0,0 +1,113 @@
+/*
+	Copyright (c) 2020 Paul Espina
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "RTC.h"
+
+#include <cstring>
+
+static constexpr uint64_t SECONDS_PER_DAY = 24 * 60 * 60;
+
+RTC::RTC()
+{
+	base_seconds = 0;
+	base_cycles = 0;
+	halted = false;
+	carry = false;
+	last_latch = 0xff;
+	memset(&latched, 0, sizeof(latched));
+}
+
+uint64_t RTC::Seconds(uint64_t cycles) const
+{
+	if(halted)
+	{
+		return base_seconds;
+	}
+	return base_seconds + (cycles - base_cycles) / CYCLES_PER_SECOND;
+}
+
+void RTC::Set(uint64_t seconds, uint64_t cycles)
+{
+	base_seconds = seconds;
+	base_cycles = cycles;
+}
+
+void RTC::Latch(uint8_t data, uint64_t cycles)
+{
+	if(last_latch == 0 && data == 1)
+	{
+		uint64_t seconds = Seconds(cycles);
+		uint64_t days = seconds / SECONDS_PER_DAY;
+		if(days >= 512)
+		{
+			// The 9-bit day counter wraps and sets the carry.
+			carry = true;
+			seconds -= days / 512 * 512 * SECONDS_PER_DAY;
+			days %= 512;
+			Set(seconds, cycles);
+		}
+		latched[0] = seconds % 60;
+		latched[1] = seconds / 60 % 60;
+		latched[2] = seconds / 3600 % 24;
+		latched[3] = days & 0xff;
+		latched[4] = (uint8_t) ((days >> 8) | (halted << 6) | (carry << 7));
+	}
+	last_latch = data;
+}
+
+uint8_t RTC::Read(uint8_t reg) const
+{
+	return reg >= 0x08 && reg <= 0x0c ? latched[reg - 0x08] : 0xff;
+}
+
+void RTC::Write(uint8_t reg, uint8_t data, uint64_t cycles)
+{
+	uint64_t seconds = Seconds(cycles);
+	uint64_t days = seconds / SECONDS_PER_DAY % 512;
+	uint64_t hours = seconds / 3600 % 24;
+	uint64_t minutes = seconds / 60 % 60;
+	seconds %= 60;
+	switch(reg)
+	{
+	case 0x08:
+		seconds = data % 60;
+		break;
+	case 0x09:
+		minutes = data % 60;
+		break;
+	case 0x0a:
+		hours = data % 24;
+		break;
+	case 0x0b:
+		days = (days & 0x100) | data;
+		break;
+	case 0x0c:
+		days = (days & 0xff) | ((data & 0x01) << 8);
+		halted = (data & 0x40) != 0;
+		carry = (data & 0x80) != 0;
+		break;
+	default:
+		return;
+	}
+	latched[reg - 0x08] = data;
+	Set(((days * 24 + hours) * 60 + minutes) * 60 + seconds, cycles);
+}
@@ -0,0 +1,55 @@
+/*
+	Copyright (c) 2020 Paul Espina
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+/*
+	MBC3 real-time clock.
+	The clock is not ticked, its time is derived from the emulated cycle count
+	whenever it is latched or written.
+*/
+class RTC
+{
+public:
+	static constexpr uint64_t CYCLES_PER_SECOND = 4194304;
+	RTC();
+	// Write to 0x6000-0x7fff, writing 0 then 1 copies the time into the latched registers.
+	void Latch(uint8_t data, uint64_t cycles);
+	// Latched register 0x08-0x0c.
+	uint8_t Read(uint8_t reg) const;
+	// Sets register 0x08-0x0c of the running clock.
+	void Write(uint8_t reg, uint8_t data, uint64_t cycles);
+private:
+	// Time at base_cycles, the clock stays there while halted.
+	uint64_t base_seconds;
+	uint64_t base_cycles;
+	bool halted;
+	// Day counter overflowed, kept until cleared by a write.
+	bool carry;
+	uint8_t last_latch;
+	// Seconds, minutes, hours, day bits 0-7 and day bit 8 | halt << 6 | carry << 7.
+	uint8_t latched[5];
+	uint64_t Seconds(uint64_t cycles) const;
+	void Set(uint64_t seconds, uint64_t cycles);
+};
@@ -0,0 +1,154 @@
+/*
+	Copyright (c) 2020 Paul Espina
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "RenderThread.h"
+
+#include <cstring>
+
+RenderThread::RenderThread(const Renderer &renderer, const uint8_t *memory)
+	: memory(new uint8_t[0x10000]), renderer(renderer, this->memory.get())
+{
+	memcpy(this->memory.get(), memory, 0x10000);
+	sleeping = false;
+	stopping = false;
+	worker = std::thread(&RenderThread::Run, this);
+}
+
+RenderThread::~RenderThread()
+{
+	{
+		std::lock_guard<std::mutex> hold(lock);
+		stopping = true;
+	}
+	wake.notify_one();
+	worker.join();
+}
+
+void RenderThread::Write(uint16_t addr, uint8_t data)
+{
+	Push({addr, data, Kind::WRITE});
+}
+
+void RenderThread::StartFrame()
+{
+	Push({0, 0, Kind::FRAME});
+}
+
+void RenderThread::RenderLine(uint8_t line)
+{
+	Push({0, line, Kind::LINE});
+	Wake();
+}
+
+void RenderThread::Sync()
+{
+	Wake();
+	while(!queue.Empty())
+	{
+		std::this_thread::yield();
+	}
+}
+
+void RenderThread::SetOutput(void *pixels, size_t pitch, PixelFormat format)
+{
+	// The worker is idle until the next Push, which publishes the change.
+	Sync();
+	renderer.SetOutput(pixels, pitch, format);
+}
+
+const Renderer &RenderThread::State() const
+{
+	return renderer;
+}
+
+void RenderThread::Push(const Entry &entry)
+{
+	while(!queue.Push(entry))
+	{
+		Wake();
+		std::this_thread::yield();
+	}
+}
+
+void RenderThread::Wake()
+{
+	// Pairs with the fence in Run, one side sees the other's store.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(sleeping.load(std::memory_order_relaxed))
+	{
+		std::lock_guard<std::mutex> hold(lock);
+		wake.notify_one();
+	}
+}
+
+void RenderThread::Run()
+{
+	int polls = 0;
+	for(;;)
+	{
+		const Entry *entries;
+		size_t count = queue.Peek(entries);
+		if(count == 0)
+		{
+			if(++polls < SPIN_POLLS)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+			polls = 0;
+			std::unique_lock<std::mutex> hold(lock);
+			sleeping.store(true, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			wake.wait(hold, [this]{ return stopping || !queue.Empty(); });
+			sleeping.store(false, std::memory_order_relaxed);
+			if(stopping && queue.Empty())
+			{
+				return;
+			}
+			continue;
+		}
+		for(size_t i = 0; i < count; i++)
+		{
+			const Entry &entry = entries[i];
+			switch(entry.kind)
+			{
+			case Kind::WRITE:
+				if(entry.addr >= 0x8000 && entry.addr < 0xa000)
+				{
+					renderer.WriteVRAM(entry.addr, entry.data);
+				}
+				else
+				{
+					memory[entry.addr] = entry.data;
+				}
+				break;
+			case Kind::FRAME:
+				renderer.StartFrame();
+				break;
+			case Kind::LINE:
+				renderer.RenderLine(entry.data);
+				break;
+			}
+		}
+		queue.Pop(count);
+	}
+}
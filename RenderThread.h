@@ -0,0 +1,83 @@
+/*
+	Copyright (c) 2020 Paul Espina
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include "Renderer.h"
+#include "SpscQueue.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/*
+	Draws lines on a worker thread so the CPU can run ahead of the renderer.
+	The worker keeps its own copy of the address space. The CPU thread logs every write
+	that can change a line's pixels, then the point where each line is drawn, through a
+	lock-free queue. The worker applies the writes in order, so each line is drawn from
+	the same state as drawing it in line would see, into the same screen.
+*/
+class RenderThread
+{
+public:
+	// Starts drawing from a copy of renderer and of memory.
+	RenderThread(const Renderer &renderer, const uint8_t *memory);
+	~RenderThread();
+	// Write to VRAM, OAM or an LCD register.
+	void Write(uint16_t addr, uint8_t data);
+	void StartFrame();
+	void RenderLine(uint8_t line);
+	// Waits until every line logged so far is drawn.
+	void Sync();
+	// Renderer::SetOutput once the lines logged so far are drawn.
+	void SetOutput(void *pixels, size_t pitch, PixelFormat format);
+	// The worker's renderer, only valid after Sync.
+	const Renderer &State() const;
+private:
+	enum class Kind : uint8_t{WRITE, FRAME, LINE};
+	struct Entry
+	{
+		uint16_t addr;
+		uint8_t data;
+		Kind kind;
+	};
+	static constexpr size_t QUEUE_SIZE = 1 << 14;
+	// Empty polls before the worker goes to sleep.
+	static constexpr int SPIN_POLLS = 64;
+	RenderThread(const RenderThread &) = delete;
+	RenderThread &operator=(const RenderThread &) = delete;
+	void Push(const Entry &entry);
+	// Wakes the worker if it sleeps.
+	void Wake();
+	void Run();
+	std::unique_ptr<uint8_t[]> memory;
+	Renderer renderer;
+	SpscQueue<Entry, QUEUE_SIZE> queue;
+	std::atomic<bool> sleeping;
+	bool stopping;
+	std::mutex lock;
+	std::condition_variable wake;
+	std::thread worker;
+};
@@ -0,0 +1,325 @@
+/*
+	Copyright (c) 2020 Paul Espina
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "Renderer.h"
+
+#include <cstring>
+
+constexpr uint16_t LCDC = 0xff40;
+constexpr uint16_t SCY = 0xff42;
+constexpr uint16_t SCX = 0xff43;
+constexpr uint16_t BGP = 0xff47;
+constexpr uint16_t OBP0 = 0xff48;
+constexpr uint16_t OBP1 = 0xff49;
+constexpr uint16_t WY = 0xff4a;
+constexpr uint16_t WX = 0xff4b;
+
+Renderer::Renderer(uint8_t *memory, uint8_t (*screen)[WIDTH])
+{
+	this->memory = memory;
+	kernels = &Pixels::Best();
+	window_line = 0;
+	memset(&damage, 0, sizeof(damage));
+	memset(&last_damage, 0, sizeof(last_damage));
+	SetOutput(screen, WIDTH, PixelFormat::INDEXED2);
+	DecodeTiles();
+}
+
+Renderer::Renderer(const Renderer &other, uint8_t *memory) : Renderer(other)
+{
+	this->memory = memory;
+}
+
+uint8_t Renderer::Register(uint16_t addr) const
+{
+	return memory[addr];
+}
+
+void Renderer::SetOutput(void *pixels, size_t pitch, PixelFormat format)
+{
+	// Shades 0-3 of the DMG run from white to black.
+	static const uint8_t GRAY[4] = {0xff, 0xaa, 0x55, 0x00};
+	output = static_cast<uint8_t *>(pixels);
+	this->pitch = pitch;
+	this->format = format;
+	// No shade is 0xff, every line is changed the next time it is drawn.
+	memset(previous, 0xff, sizeof(previous));
+	for(int shade = 0; shade < 4; shade++)
+	{
+		uint8_t gray = GRAY[shade];
+		uint8_t rgba[4] = {gray, gray, gray, 0xff};
+		switch(format)
+		{
+		case PixelFormat::INDEXED2:
+			format_shades[shade] = shade;
+			break;
+		case PixelFormat::GRAY8:
+			format_shades[shade] = gray;
+			break;
+		case PixelFormat::RGB565:
+			format_shades[shade] = (gray >> 3) << 11 | (gray >> 2) << 5 | gray >> 3;
+			break;
+		case PixelFormat::RGBA8888:
+			memcpy(&format_shades[shade], rgba, sizeof(rgba));
+			break;
+		}
+	}
+}
+
+size_t Renderer::BytesPerPixel(PixelFormat format)
+{
+	switch(format)
+	{
+	case PixelFormat::RGB565:
+		return 2;
+	case PixelFormat::RGBA8888:
+		return 4;
+	default:
+		return 1;
+	}
+}
+
+void Renderer::DecodeTiles()
+{
+	kernels->decode(&memory[0x8000], tiles[0][0], TILES * 8);
+}
+
+void Renderer::WriteVRAM(uint16_t addr, uint8_t data)
+{
+	memory[addr] = data;
+	if(addr < 0x9800)
+	{
+		kernels->decode(&memory[addr & ~1], tiles[(addr - 0x8000) >> 4][(addr >> 1) & 7], 1);
+	}
+}
+
+void Renderer::StartFrame()
+{
+	window_line = 0;
+}
+
+const uint8_t *Renderer::BackgroundTile(uint8_t index, int row)
+{
+	// LCDC bit 4 selects unsigned indices from 0x8000 or signed ones from 0x9000.
+	if(Register(LCDC) & 0x10)
+	{
+		return tiles[index][row];
+	}
+	return tiles[256 + (int8_t) index][row];
+}
+
+void Renderer::RenderLine(uint8_t line)
+{
+	uint8_t colors[WIDTH];
+	uint8_t shades[WIDTH];
+	uint8_t *row = output + line * pitch;
+	// Shades go straight to the output when it holds them as they are.
+	uint8_t *pixels = format == PixelFormat::INDEXED2 ? row : shades;
+	uint8_t lcdc = Register(LCDC);
+	if(lcdc & 0x01)
+	{
+		RenderBackground(line, colors);
+	}
+	else
+	{
+		memset(colors, 0, sizeof(colors));
+	}
+	kernels->palette(colors, Register(BGP), pixels, WIDTH);
+	if(lcdc & 0x02)
+	{
+		uint8_t sprites[WIDTH] = {};
+		RenderSprites(line, sprites);
+		kernels->composite(colors, sprites, Register(OBP0), Register(OBP1), pixels, WIDTH);
+	}
+	TrackDamage(line, pixels);
+	if(format != PixelFormat::INDEXED2)
+	{
+		kernels->expand(pixels, format_shades, (int) BytesPerPixel(format), row, WIDTH);
+	}
+}
+
+void Renderer::TrackDamage(uint8_t line, const uint8_t *shades)
+{
+	uint8_t *last = previous[line];
+	if(memcmp(last, shades, WIDTH) != 0)
+	{
+		int left = 0;
+		int right = WIDTH;
+		while(last[left] == shades[left])
+		{
+			left++;
+		}
+		while(last[right - 1] == shades[right - 1])
+		{
+			right--;
+		}
+		damage.lines[line / 64] |= 1ull << (line % 64);
+		damage.left[line] = left;
+		damage.right[line] = right;
+		memcpy(last, shades, WIDTH);
+	}
+	if(line == HEIGHT - 1)
+	{
+		last_damage = damage;
+		memset(damage.lines, 0, sizeof(damage.lines));
+	}
+}
+
+const Renderer::Damage &Renderer::LastDamage() const
+{
+	return last_damage;
+}
+
+bool Renderer::Damage::Changed(int y) const
+{
+	return (lines[y / 64] >> (y % 64)) & 1;
+}
+
+int Renderer::Damage::Count() const
+{
+	int count = 0;
+	for(int y = 0; y < HEIGHT; y++)
+	{
+		count += Changed(y);
+	}
+	return count;
+}
+
+size_t Renderer::Damage::Rects(Rect *rects, size_t max) const
+{
+	size_t count = 0;
+	for(int y = 0; y < HEIGHT && max > 0; y++)
+	{
+		if(!Changed(y))
+		{
+			continue;
+		}
+		int top = y;
+		int left = this->left[y];
+		int right = this->right[y];
+		while(y + 1 < HEIGHT && Changed(y + 1))
+		{
+			y++;
+			left = this->left[y] < left ? this->left[y] : left;
+			right = this->right[y] > right ? this->right[y] : right;
+		}
+		if(count == max)
+		{
+			// Out of rectangles, grow the last one over this run.
+			Rect &last = rects[count - 1];
+			int last_left = last.x < left ? last.x : left;
+			int last_right = last.x + last.width > right ? last.x + last.width : right;
+			last.x = last_left;
+			last.width = last_right - last_left;
+			last.height = y + 1 - last.y;
+			continue;
+		}
+		rects[count++] = {(uint8_t) left, (uint8_t) top, (uint8_t) (right - left), (uint8_t) (y + 1 - top)};
+	}
+	return count;
+}
+
+void Renderer::RenderBackground(uint8_t line, uint8_t *colors)
+{
+	uint8_t lcdc = Register(LCDC);
+	int window_x = Register(WX) - 7;
+	bool window = (lcdc & 0x20) && line >= Register(WY) && window_x < WIDTH;
+	int end = window ? (window_x < 0 ? 0 : window_x) : WIDTH;
+	// Background, one tile row at a time.
+	uint8_t y = line + Register(SCY);
+	uint16_t map = (lcdc & 0x08 ? 0x9c00 : 0x9800) + (y / 8) * 32;
+	uint8_t scx = Register(SCX);
+	int skip = scx & 7;
+	for(int x = 0, column = scx / 8; x < end; column++)
+	{
+		const uint8_t *row = BackgroundTile(memory[map + (column & 31)], y & 7);
+		int count = 8 - skip < end - x ? 8 - skip : end - x;
+		memcpy(&colors[x], row + skip, count);
+		x += count;
+		skip = 0;
+	}
+	if(!window)
+	{
+		return;
+	}
+	// Window, starting at WX - 7 from its own line counter.
+	map = (lcdc & 0x40 ? 0x9c00 : 0x9800) + (window_line / 8) * 32;
+	skip = window_x < 0 ? -window_x : 0;
+	for(int x = end, column = 0; x < WIDTH; column++)
+	{
+		const uint8_t *row = BackgroundTile(memory[map + column], window_line & 7);
+		int count = 8 - skip < WIDTH - x ? 8 - skip : WIDTH - x;
+		memcpy(&colors[x], row + skip, count);
+		x += count;
+		skip = 0;
+	}
+	window_line++;
+}
+
+void Renderer::RenderSprites(uint8_t line, uint8_t *sprites)
+{
+	int height = Register(LCDC) & 0x04 ? 16 : 8;
+	// Up to 10 sprites per line in OAM order, then ordered by X, the first one drawn wins.
+	const uint8_t *visible[10];
+	int count = 0;
+	for(int i = 0; i < 40 && count < 10; i++)
+	{
+		const uint8_t *sprite = &memory[0xfe00 + i * 4];
+		int row = line - (sprite[0] - 16);
+		if(row >= 0 && row < height)
+		{
+			int at = count++;
+			while(at > 0 && visible[at - 1][1] > sprite[1])
+			{
+				visible[at] = visible[at - 1];
+				at--;
+			}
+			visible[at] = sprite;
+		}
+	}
+	for(int i = 0; i < count; i++)
+	{
+		const uint8_t *sprite = visible[i];
+		uint8_t flags = sprite[3];
+		int row = line - (sprite[0] - 16);
+		if(flags & 0x40)
+		{
+			row = height - 1 - row;
+		}
+		uint8_t index = height == 16 ? sprite[2] & 0xfe : sprite[2];
+		const uint8_t *tile = tiles[index + row / 8][row & 7];
+		uint8_t attributes = flags & (Pixels::SPRITE_PALETTE | Pixels::SPRITE_BEHIND);
+		for(int column = 0; column < 8; column++)
+		{
+			int x = sprite[1] - 8 + column;
+			if(x < 0 || x >= WIDTH || sprites[x] != 0)
+			{
+				continue;
+			}
+			uint8_t color = tile[flags & 0x20 ? 7 - column : column];
+			if(color != 0)
+			{
+				sprites[x] = color | attributes;
+			}
+		}
+	}
+}
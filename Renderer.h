@@ -0,0 +1,121 @@
+/*
+	Copyright (c) 2020 Paul Espina
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include "Pixels.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Pixel formats lines can be drawn in, one row of WIDTH pixels per line.
+enum class PixelFormat
+{
+	// One byte per pixel holding the shade 0-3, 0 is the lightest.
+	INDEXED2,
+	// One byte per pixel, 0xff white to 0x00 black.
+	GRAY8,
+	// uint16_t per pixel in native byte order.
+	RGB565,
+	// Bytes R, G, B, A per pixel.
+	RGBA8888
+};
+
+/*
+	Draws lines from the VRAM, OAM and LCD registers in memory into an output buffer.
+	Tile data is read from a cache of decoded tiles kept up to date by WriteVRAM.
+	Each line is converted to the output format as it is drawn.
+*/
+class Renderer
+{
+public:
+	static constexpr int WIDTH = 160;
+	static constexpr int HEIGHT = 144;
+	// Tiles at 0x8000-0x97ff.
+	static constexpr int TILES = 384;
+	// Rectangle of pixels.
+	struct Rect
+	{
+		uint8_t x;
+		uint8_t y;
+		uint8_t width;
+		uint8_t height;
+	};
+	// Lines of a frame that differ from the frame drawn before it.
+	struct Damage
+	{
+		// Bit y % 64 of lines[y / 64] is set if line y changed.
+		uint64_t lines[(HEIGHT + 63) / 64];
+		// Columns left to right - 1 hold every change of a changed line.
+		uint8_t left[HEIGHT];
+		uint8_t right[HEIGHT];
+		bool Changed(int y) const;
+		int Count() const;
+		// Bounding rectangles of the runs of changed lines, returns the number written. Past
+		// max rectangles, the rest is merged into the last one.
+		size_t Rects(Rect *rects, size_t max) const;
+	};
+	// memory is the 64 KiB address space, lines are drawn into screen as INDEXED2 until SetOutput.
+	Renderer(uint8_t *memory, uint8_t (*screen)[WIDTH]);
+	// Copy of other drawing from memory instead.
+	Renderer(const Renderer &other, uint8_t *memory);
+	// Decodes every tile from memory.
+	void DecodeTiles();
+	// Write to VRAM at 0x8000-0x9fff, all writes to tile data have to go through here.
+	void WriteVRAM(uint16_t addr, uint8_t data);
+	// Draws line y into the row at pixels + y * pitch. pixels and pitch have to be aligned
+	// to the size of a pixel and stay valid until the output is changed.
+	void SetOutput(void *pixels, size_t pitch, PixelFormat format);
+	static size_t BytesPerPixel(PixelFormat format);
+	// Starts the window over from its first line.
+	void StartFrame();
+	void RenderLine(uint8_t line);
+	// Lines changed by the last frame drawn to its last line. Every line counts as changed
+	// the first time it is drawn after SetOutput.
+	const Damage &LastDamage() const;
+private:
+	uint8_t *memory;
+	uint8_t *output;
+	size_t pitch;
+	PixelFormat format;
+	// Pixel of each shade in format, in the low bytes.
+	uint32_t format_shades[4];
+	const Pixels::Kernels *kernels;
+	// Line of the window to draw next, only advances on lines that show the window.
+	uint8_t window_line;
+	// Color indices 0-3 of every tile row, decoded from the two bitplanes.
+	uint8_t tiles[TILES][8][8];
+	// Shades of each line as last drawn, compared with the new ones for damage.
+	uint8_t previous[HEIGHT][WIDTH];
+	// Changes of the frame being drawn, and of the last one finished.
+	Damage damage;
+	Damage last_damage;
+	uint8_t Register(uint16_t addr) const;
+	// Background and window color indices of the line, 0-3 before BGP.
+	void RenderBackground(uint8_t line, uint8_t *colors);
+	// Sprite pixels of the line for Pixels::Kernels::composite, the first sprite drawn wins.
+	void RenderSprites(uint8_t line, uint8_t *sprites);
+	// Compares the new shades of line with previous.
+	void TrackDamage(uint8_t line, const uint8_t *shades);
+	// Row of tile index for the background and window.
+	const uint8_t *BackgroundTile(uint8_t index, int row);
+};
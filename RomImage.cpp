@@ -0,0 +1,184 @@
+/*
+	Copyright (c) 2020 Paul Espina
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "RomImage.h"
+
+#include <cstring>
+#include <fstream>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+RomImage::RomImage()
+{
+	data = nullptr;
+	size = 0;
+	mapping = nullptr;
+#if defined(_WIN32)
+	file_handle = INVALID_HANDLE_VALUE;
+	mapping_handle = nullptr;
+#endif
+}
+
+RomImage::~RomImage()
+{
+	if(mapping == nullptr)
+	{
+		return;
+	}
+#if defined(_WIN32)
+	UnmapViewOfFile(mapping);
+	CloseHandle(mapping_handle);
+	CloseHandle(file_handle);
+#else
+	munmap(mapping, size);
+#endif
+}
+
+size_t RomImage::PaddedSize(size_t size)
+{
+	size_t padded = 0x8000;
+	while(padded < size)
+	{
+		padded *= 2;
+	}
+	return padded;
+}
+
+std::unique_ptr<RomImage> RomImage::Load(const std::string &path)
+{
+	std::unique_ptr<RomImage> image(new RomImage());
+#if defined(_WIN32)
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if(file == INVALID_HANDLE_VALUE)
+	{
+		return nullptr;
+	}
+	LARGE_INTEGER length;
+	if(!GetFileSizeEx(file, &length) || (size_t) length.QuadPart != PaddedSize((size_t) length.QuadPart))
+	{
+		// Only whole images are mapped, anything else is read and padded.
+		CloseHandle(file);
+		return Read(path);
+	}
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	void *view = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if(view == nullptr)
+	{
+		if(mapping != nullptr)
+		{
+			CloseHandle(mapping);
+		}
+		CloseHandle(file);
+		return Read(path);
+	}
+	image->file_handle = file;
+	image->mapping_handle = mapping;
+	image->mapping = view;
+	image->size = (size_t) length.QuadPart;
+#else
+	int file = open(path.c_str(), O_RDONLY);
+	if(file < 0)
+	{
+		return nullptr;
+	}
+	struct stat info;
+	if(fstat(file, &info) != 0 || (size_t) info.st_size != PaddedSize((size_t) info.st_size))
+	{
+		// Only whole images are mapped, anything else is read and padded.
+		close(file);
+		return Read(path);
+	}
+	void *view = mmap(nullptr, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+	if(view == MAP_FAILED)
+	{
+		return Read(path);
+	}
+	// Hints only, failures are ignored.
+	madvise(view, (size_t) info.st_size, MADV_WILLNEED);
+#if defined(MADV_HUGEPAGE)
+	madvise(view, (size_t) info.st_size, MADV_HUGEPAGE);
+#endif
+	image->mapping = view;
+	image->size = (size_t) info.st_size;
+#endif
+	image->data = (const uint8_t *) image->mapping;
+	return image;
+}
+
+std::unique_ptr<RomImage> RomImage::Read(const std::string &path)
+{
+	std::ifstream file(path, std::ifstream::binary | std::ifstream::in);
+	if(!file.is_open())
+	{
+		return nullptr;
+	}
+	file.seekg(0, std::ios::end);
+	std::streamoff length = file.tellg();
+	file.seekg(0, std::ios::beg);
+	if(length < 0)
+	{
+		return nullptr;
+	}
+	std::unique_ptr<RomImage> image(new RomImage());
+	image->buffer.assign(PaddedSize((size_t) length), 0xff);
+	file.read((char *) image->buffer.data(), length);
+	image->data = image->buffer.data();
+	image->size = image->buffer.size();
+	return image;
+}
+
+std::unique_ptr<RomImage> RomImage::FromBytes(const uint8_t *data, size_t size)
+{
+	std::unique_ptr<RomImage> image(new RomImage());
+	image->buffer.assign(PaddedSize(size), 0xff);
+	if(size > 0)
+	{
+		memcpy(image->buffer.data(), data, size);
+	}
+	image->data = image->buffer.data();
+	image->size = image->buffer.size();
+	return image;
+}
+
+const uint8_t *RomImage::Data() const
+{
+	return data;
+}
+
+size_t RomImage::Size() const
+{
+	return size;
+}
+
+bool RomImage::Mapped() const
+{
+	return mapping != nullptr;
+}
@@ -0,0 +1,64 @@
+/*
+	Copyright (c) 2020 Paul Espina
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+	Read-only cartridge ROM.
+	Load maps the file into memory so the core reads it in place, files that cannot be
+	mapped are read into a buffer instead. Either way Data() holds at least 32 KiB and
+	a power of two number of 16 KiB banks, padded with 0xff.
+*/
+class RomImage
+{
+public:
+	~RomImage();
+	// Maps the file at path, reads it if it cannot be mapped. Returns nullptr if it cannot be opened.
+	static std::unique_ptr<RomImage> Load(const std::string &path);
+	// Reads the file at path into a buffer. Returns nullptr if it cannot be opened.
+	static std::unique_ptr<RomImage> Read(const std::string &path);
+	// Copies size bytes of data into a buffer.
+	static std::unique_ptr<RomImage> FromBytes(const uint8_t *data, size_t size);
+	const uint8_t *Data() const;
+	size_t Size() const;
+	// True if Data() points into a mapping of the file.
+	bool Mapped() const;
+private:
+	RomImage();
+	RomImage(const RomImage &) = delete;
+	RomImage &operator=(const RomImage &) = delete;
+	// Size of a padded image holding size bytes.
+	static size_t PaddedSize(size_t size);
+	const uint8_t *data;
+	size_t size;
+	std::vector<uint8_t> buffer;
+	void *mapping;
+#if defined(_WIN32)
+	void *file_handle;
+	void *mapping_handle;
+#endif
+};
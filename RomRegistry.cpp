@@ -0,0 +1,152 @@
+/*
+	Copyright (c) 2020 Paul Espina
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "RomRegistry.h"
+
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+std::mutex RomRegistry::lock;
+std::unordered_multimap<uint64_t, std::weak_ptr<const RomImage>> RomRegistry::images;
+std::unordered_map<std::string, std::weak_ptr<const RomImage>> RomRegistry::files;
+
+std::shared_ptr<const RomImage> RomRegistry::Acquire(const std::string &path)
+{
+	std::string key;
+	bool keyed = FileKey(path, key);
+	if(keyed)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		auto it = files.find(key);
+		if(it != files.end())
+		{
+			std::shared_ptr<const RomImage> loaded = it->second.lock();
+			if(loaded != nullptr)
+			{
+				return loaded;
+			}
+			files.erase(it);
+		}
+	}
+	std::unique_ptr<RomImage> image = RomImage::Load(path);
+	if(image == nullptr)
+	{
+		return nullptr;
+	}
+	std::shared_ptr<const RomImage> shared = Acquire(std::move(image));
+	if(keyed)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		files[key] = shared;
+	}
+	return shared;
+}
+
+std::shared_ptr<const RomImage> RomRegistry::Acquire(std::unique_ptr<RomImage> image)
+{
+	uint64_t hash = Hash(*image);
+	std::lock_guard<std::mutex> guard(lock);
+	auto range = images.equal_range(hash);
+	for(auto it = range.first; it != range.second;)
+	{
+		std::shared_ptr<const RomImage> loaded = it->second.lock();
+		if(loaded == nullptr)
+		{
+			it = images.erase(it);
+			continue;
+		}
+		if(loaded->Size() == image->Size() && memcmp(loaded->Data(), image->Data(), image->Size()) == 0)
+		{
+			// image is unmapped here, every instance reads the copy loaded first.
+			return loaded;
+		}
+		++it;
+	}
+	std::shared_ptr<const RomImage> shared(std::move(image));
+	images.emplace(hash, shared);
+	return shared;
+}
+
+bool RomRegistry::FileKey(const std::string &path, std::string &key)
+{
+#if defined(_WIN32)
+	WIN32_FILE_ATTRIBUTE_DATA info;
+	if(!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &info))
+	{
+		return false;
+	}
+	uint64_t identity[3] = {0, ((uint64_t) info.nFileSizeHigh << 32) | info.nFileSizeLow,
+		((uint64_t) info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime};
+#else
+	struct stat info;
+	if(stat(path.c_str(), &info) != 0)
+	{
+		return false;
+	}
+#if defined(__APPLE__)
+	const struct timespec &modified = info.st_mtimespec;
+#else
+	const struct timespec &modified = info.st_mtim;
+#endif
+	uint64_t identity[5] = {(uint64_t) info.st_dev, (uint64_t) info.st_ino, (uint64_t) info.st_size,
+		(uint64_t) modified.tv_sec, (uint64_t) modified.tv_nsec};
+#endif
+	key = path;
+	key.append((const char *) identity, sizeof(identity));
+	return true;
+}
+
+size_t RomRegistry::Count()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	size_t count = 0;
+	for(auto it = images.begin(); it != images.end();)
+	{
+		if(it->second.expired())
+		{
+			it = images.erase(it);
+			continue;
+		}
+		count++;
+		++it;
+	}
+	return count;
+}
+
+uint64_t RomRegistry::Hash(const RomImage &image)
+{
+	// FNV-1a over 64-bit words, images are a whole number of 16 KiB banks.
+	uint64_t hash = 14695981039346656037ull;
+	const uint8_t *data = image.Data();
+	for(size_t i = 0, size = image.Size(); i < size; i += 8)
+	{
+		uint64_t word;
+		memcpy(&word, data + i, sizeof(word));
+		hash = (hash ^ word) * 1099511628211ull;
+	}
+	return hash;
+}
@@ -0,0 +1,60 @@
+/*
+	Copyright (c) 2020 Paul Espina
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include "RomImage.h"
+
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/*
+	Process-wide set of loaded ROMs keyed by a hash of their contents.
+	Every Z80 running the same game shares one read-only RomImage, an image
+	is unloaded when the last Z80 holding it lets it go. Files are also keyed by
+	path, inode, size and modification time, so acquiring an unchanged file again
+	neither reads nor hashes it.
+*/
+class RomRegistry
+{
+public:
+	// Returns the image with the contents of the file at path, loading it if no
+	// instance holds it yet. Returns nullptr if the file cannot be read.
+	static std::shared_ptr<const RomImage> Acquire(const std::string &path);
+	// Same as Acquire for an image already in memory.
+	static std::shared_ptr<const RomImage> Acquire(std::unique_ptr<RomImage> image);
+	// Number of images currently held by some instance.
+	static size_t Count();
+private:
+	static uint64_t Hash(const RomImage &image);
+	// Sets key to the path, device, inode, size and modification time of the file at path,
+	// returns false if it cannot be queried.
+	static bool FileKey(const std::string &path, std::string &key);
+	static std::mutex lock;
+	// Images by Hash, several when the hashes of different contents collide.
+	static std::unordered_multimap<uint64_t, std::weak_ptr<const RomImage>> images;
+	// Images by FileKey of the file they were loaded from.
+	static std::unordered_map<std::string, std::weak_ptr<const RomImage>> files;
+};
@@ -0,0 +1,223 @@
+/*
+	Copyright (c) 2020 Paul Espina
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "SaveRam.h"
+
+#include <fstream>
+#include <iostream>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+SaveRam::SaveRam()
+{
+	data = nullptr;
+	size = 0;
+	mapping = nullptr;
+#if defined(_WIN32)
+	file_handle = INVALID_HANDLE_VALUE;
+	mapping_handle = nullptr;
+#else
+	file_descriptor = -1;
+#endif
+}
+
+SaveRam::~SaveRam()
+{
+	if(mapping == nullptr)
+	{
+		return;
+	}
+#if defined(_WIN32)
+	FlushViewOfFile(mapping, size);
+	UnmapViewOfFile(mapping);
+	CloseHandle(mapping_handle);
+	CloseHandle(file_handle);
+#else
+	msync(mapping, size, MS_SYNC);
+	munmap(mapping, size);
+	close(file_descriptor);
+#endif
+}
+
+size_t SaveRam::PaddedSize(size_t size)
+{
+	size_t padded = 0x2000;
+	while(padded < size)
+	{
+		padded *= 2;
+	}
+	return padded;
+}
+
+std::unique_ptr<SaveRam> SaveRam::Open(const std::string &path, size_t size)
+{
+	size = PaddedSize(size);
+	std::unique_ptr<SaveRam> ram(new SaveRam());
+#if defined(_WIN32)
+	// Only sharing reads locks the file against other writers.
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(file == INVALID_HANDLE_VALUE && GetLastError() == ERROR_SHARING_VIOLATION)
+	{
+		std::cout << "ERROR:SAVERAM::IN_USE " << path << "\n";
+		return Copy(path, size);
+	}
+	if(file == INVALID_HANDLE_VALUE)
+	{
+		std::cout << "ERROR:SAVERAM::OPEN_FAILED " << path << "\n";
+		return Create(size);
+	}
+	// The mapping extends a shorter file to size.
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, 0, (DWORD) size, nullptr);
+	void *view = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size) : nullptr;
+	if(view == nullptr)
+	{
+		std::cout << "ERROR:SAVERAM::MAP_FAILED " << path << "\n";
+		if(mapping != nullptr)
+		{
+			CloseHandle(mapping);
+		}
+		CloseHandle(file);
+		return Create(size);
+	}
+	ram->file_handle = file;
+	ram->mapping_handle = mapping;
+#else
+	int file = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if(file < 0)
+	{
+		std::cout << "ERROR:SAVERAM::OPEN_FAILED " << path << "\n";
+		return Create(size);
+	}
+	if(flock(file, LOCK_EX | LOCK_NB) != 0)
+	{
+		std::cout << "ERROR:SAVERAM::IN_USE " << path << "\n";
+		close(file);
+		return Copy(path, size);
+	}
+	struct stat info;
+	if(fstat(file, &info) != 0 || ((size_t) info.st_size < size && ftruncate(file, (off_t) size) != 0))
+	{
+		std::cout << "ERROR:SAVERAM::RESIZE_FAILED " << path << "\n";
+		close(file);
+		return Create(size);
+	}
+	void *view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+	if(view == MAP_FAILED)
+	{
+		std::cout << "ERROR:SAVERAM::MAP_FAILED " << path << "\n";
+		close(file);
+		return Create(size);
+	}
+	ram->file_descriptor = file;
+#endif
+	ram->mapping = view;
+	ram->data = (uint8_t *) view;
+	ram->size = size;
+	ram->dirty.assign(size / PAGE_SIZE, false);
+	return ram;
+}
+
+std::unique_ptr<SaveRam> SaveRam::Create(size_t size)
+{
+	std::unique_ptr<SaveRam> ram(new SaveRam());
+	ram->buffer.assign(PaddedSize(size), 0);
+	ram->data = ram->buffer.data();
+	ram->size = ram->buffer.size();
+	ram->dirty.assign(ram->size / PAGE_SIZE, false);
+	return ram;
+}
+
+std::unique_ptr<SaveRam> SaveRam::Copy(const std::string &path, size_t size)
+{
+	std::unique_ptr<SaveRam> ram = Create(size);
+	std::ifstream file(path, std::ios::binary);
+	file.read((char *) ram->data, (std::streamsize) ram->size);
+	return ram;
+}
+
+uint8_t *SaveRam::Data()
+{
+	return data;
+}
+
+size_t SaveRam::Size() const
+{
+	return size;
+}
+
+bool SaveRam::Persistent() const
+{
+	return mapping != nullptr;
+}
+
+bool SaveRam::Dirty(size_t offset) const
+{
+	return dirty[offset / PAGE_SIZE];
+}
+
+void SaveRam::MarkDirty(size_t offset)
+{
+	dirty[offset / PAGE_SIZE] = true;
+}
+
+void SaveRam::Flush()
+{
+	if(mapping == nullptr)
+	{
+		return;
+	}
+#if defined(_WIN32)
+	size_t granularity = 4096;
+#else
+	size_t granularity = (size_t) sysconf(_SC_PAGESIZE);
+#endif
+	// Runs of dirty pages, widened to whole OS pages.
+	for(size_t page = 0, count = dirty.size(); page < count;)
+	{
+		if(!dirty[page])
+		{
+			page++;
+			continue;
+		}
+		size_t start = page * PAGE_SIZE / granularity * granularity;
+		while(page < count && (dirty[page] || page * PAGE_SIZE < start + granularity))
+		{
+			dirty[page] = false;
+			page++;
+		}
+		size_t end = page * PAGE_SIZE;
+#if defined(_WIN32)
+		FlushViewOfFile(data + start, end - start);
+#else
+		msync(data + start, end - start, MS_ASYNC);
+#endif
+	}
+}
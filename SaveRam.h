@@ -0,0 +1,79 @@
+/*
+	Copyright (c) 2020 Paul Espina
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+	Cartridge RAM.
+	Battery-backed RAM is a shared mapping of the .sav file, so the OS writes it back and
+	a save never rewrites the whole file. Writes are tracked per 256-byte page, Flush only
+	schedules the pages written since the last Flush and does not wait for the disk.
+	The file is locked while it is open: another instance opening it runs on a copy that is
+	not saved, so two instances never write over each other's RAM.
+*/
+class SaveRam
+{
+public:
+	// Size of a page tracked by Dirty, the same as a page of the memory map.
+	static constexpr size_t PAGE_SIZE = 0x100;
+	~SaveRam();
+	// RAM backed by the file at path, created or extended to size. Returns RAM that is
+	// not saved if the file cannot be mapped, holding its contents if it is locked by another instance.
+	static std::unique_ptr<SaveRam> Open(const std::string &path, size_t size);
+	// RAM that is not saved.
+	static std::unique_ptr<SaveRam> Create(size_t size);
+	uint8_t *Data();
+	// At least one 8 KiB bank, a power of two.
+	size_t Size() const;
+	// True if Data() is backed by a file.
+	bool Persistent() const;
+	// True if the page holding offset was written since the last Flush.
+	bool Dirty(size_t offset) const;
+	void MarkDirty(size_t offset);
+	// Schedules the dirty pages to be written to the file without waiting, clears Dirty.
+	void Flush();
+private:
+	SaveRam();
+	SaveRam(const SaveRam &) = delete;
+	SaveRam &operator=(const SaveRam &) = delete;
+	// Size holding size bytes.
+	static size_t PaddedSize(size_t size);
+	// RAM that is not saved, holding the contents of the file at path.
+	static std::unique_ptr<SaveRam> Copy(const std::string &path, size_t size);
+	uint8_t *data;
+	size_t size;
+	std::vector<uint8_t> buffer;
+	void *mapping;
+	std::vector<bool> dirty;
+#if defined(_WIN32)
+	void *file_handle;
+	void *mapping_handle;
+#else
+	// Kept open to hold the lock.
+	int file_descriptor;
+#endif
+};
@@ -0,0 +1,119 @@
+/*
+	Copyright (c) 2020 Paul Espina
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "Scheduler.h"
+
+Scheduler::Scheduler()
+{
+	count = 0;
+	for(int i = 0; i < EVENTS; i++)
+	{
+		position[i] = -1;
+	}
+}
+
+void Scheduler::Schedule(Event event, uint64_t when)
+{
+	int index = position[(int) event];
+	if(index < 0)
+	{
+		index = count++;
+		heap[index].event = event;
+		position[(int) event] = index;
+	}
+	heap[index].when = when;
+	Fix(index);
+}
+
+void Scheduler::Cancel(Event event)
+{
+	int index = position[(int) event];
+	if(index >= 0)
+	{
+		Remove(index);
+	}
+}
+
+uint64_t Scheduler::When(Event event) const
+{
+	int index = position[(int) event];
+	return index >= 0 ? heap[index].when : NEVER;
+}
+
+bool Scheduler::Pop(uint64_t now, Event &event)
+{
+	if(count == 0 || heap[0].when > now)
+	{
+		return false;
+	}
+	event = heap[0].event;
+	Remove(0);
+	return true;
+}
+
+void Scheduler::Remove(int index)
+{
+	position[(int) heap[index].event] = -1;
+	count--;
+	if(index == count)
+	{
+		return;
+	}
+	heap[index] = heap[count];
+	position[(int) heap[index].event] = index;
+	Fix(index);
+}
+
+void Scheduler::Fix(int index)
+{
+	while(index > 0 && heap[index].when < heap[(index - 1) / 2].when)
+	{
+		Swap(index, (index - 1) / 2);
+		index = (index - 1) / 2;
+	}
+	for(;;)
+	{
+		int smallest = index;
+		for(int child = index * 2 + 1; child <= index * 2 + 2 && child < count; child++)
+		{
+			if(heap[child].when < heap[smallest].when)
+			{
+				smallest = child;
+			}
+		}
+		if(smallest == index)
+		{
+			return;
+		}
+		Swap(index, smallest);
+		index = smallest;
+	}
+}
+
+void Scheduler::Swap(int a, int b)
+{
+	Entry entry = heap[a];
+	heap[a] = heap[b];
+	heap[b] = entry;
+	position[(int) heap[a].event] = a;
+	position[(int) heap[b].event] = b;
+}
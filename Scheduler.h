@@ -0,0 +1,69 @@
+/*
+	Copyright (c) 2020 Paul Espina
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+/*
+	Deadlines of the peripherals in absolute T-states, kept in a binary heap.
+	Each kind of event is pending at most once, scheduling it again moves it.
+	The CPU loop only compares the cycle count with Next, so a peripheral costs
+	nothing between its events.
+*/
+class Scheduler
+{
+public:
+	enum class Event : uint8_t{PPU, TIMER, COUNT};
+	static constexpr uint64_t NEVER = UINT64_MAX;
+	Scheduler();
+	// Sets the deadline of event to when.
+	void Schedule(Event event, uint64_t when);
+	void Cancel(Event event);
+	// Deadline of event, NEVER if it is not pending.
+	uint64_t When(Event event) const;
+	// Deadline of the earliest pending event, NEVER if there is none.
+	uint64_t Next() const
+	{
+		return count > 0 ? heap[0].when : NEVER;
+	}
+	// Removes the earliest event if it is due at now, returns false if none is.
+	bool Pop(uint64_t now, Event &event);
+private:
+	static constexpr int EVENTS = (int) Event::COUNT;
+	// Room in the heap, enough for every kind of event the machine will have.
+	static constexpr int CAPACITY = 8;
+	static_assert(EVENTS <= CAPACITY, "Scheduler heap too small");
+	struct Entry
+	{
+		uint64_t when;
+		Event event;
+	};
+	Entry heap[CAPACITY];
+	// Index of each event in heap, -1 if it is not pending.
+	int position[EVENTS];
+	int count;
+	void Remove(int index);
+	// Restores the heap order around index after its deadline changed.
+	void Fix(int index);
+	void Swap(int a, int b);
+};
@@ -0,0 +1,88 @@
+/*
+	Copyright (c) 2020 Paul Espina
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+
+/*
+	Lock-free ring buffer between one producer thread and one consumer thread.
+	Each side keeps a cached copy of the other's index, so it only touches the
+	other side's cache line when the queue looks full or empty.
+*/
+template<class T, size_t SIZE>
+class SpscQueue
+{
+	static_assert(SIZE != 0 && (SIZE & (SIZE - 1)) == 0, "SpscQueue size must be a power of two");
+public:
+	SpscQueue() : head(0), tail_cache(0), tail(0), head_cache(0)
+	{
+	}
+	// Producer: appends value, returns false if the queue is full.
+	bool Push(const T &value)
+	{
+		size_t at = head.load(std::memory_order_relaxed);
+		if(at - tail_cache == SIZE)
+		{
+			tail_cache = tail.load(std::memory_order_acquire);
+			if(at - tail_cache == SIZE)
+			{
+				return false;
+			}
+		}
+		entries[at & (SIZE - 1)] = value;
+		head.store(at + 1, std::memory_order_release);
+		return true;
+	}
+	// Consumer: the oldest entries that are contiguous in the ring, they stay queued until Pop.
+	size_t Peek(const T *&first)
+	{
+		size_t at = tail.load(std::memory_order_relaxed);
+		if(head_cache == at)
+		{
+			head_cache = head.load(std::memory_order_acquire);
+		}
+		size_t count = head_cache - at;
+		size_t contiguous = SIZE - (at & (SIZE - 1));
+		first = &entries[at & (SIZE - 1)];
+		return count < contiguous ? count : contiguous;
+	}
+	// Consumer: releases count entries returned by Peek.
+	void Pop(size_t count)
+	{
+		tail.store(tail.load(std::memory_order_relaxed) + count, std::memory_order_release);
+	}
+	// True once every entry pushed has been popped, from either side.
+	bool Empty() const
+	{
+		return tail.load(std::memory_order_acquire) == head.load(std::memory_order_acquire);
+	}
+private:
+	// Next slot to write, and the producer's copy of tail.
+	alignas(64) std::atomic<size_t> head;
+	size_t tail_cache;
+	// Next slot to read, and the consumer's copy of head.
+	alignas(64) std::atomic<size_t> tail;
+	size_t head_cache;
+	alignas(64) T entries[SIZE];
+};
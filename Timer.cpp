@@ -0,0 +1,151 @@
+/*
+	Copyright (c) 2020 Paul Espina
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "Timer.h"
+
+constexpr uint16_t DIV = 0xff04;
+constexpr uint16_t TIMA = 0xff05;
+constexpr uint16_t TMA = 0xff06;
+constexpr uint16_t TAC = 0xff07;
+constexpr uint16_t IF = 0xff0f;
+
+constexpr uint8_t INTERRUPT_TIMER = 0x04;
+
+// Counter bit of each TAC clock select, 4096, 262144, 65536 and 16384 Hz.
+constexpr int CLOCK_BITS[4] = {9, 3, 5, 7};
+
+Timer::Timer(uint8_t *memory)
+{
+	this->memory = memory;
+	counter_offset = 0;
+	counter = 0;
+	tima = 0;
+}
+
+void Timer::Reset(uint64_t cycles)
+{
+	// DIV reads 0xab after the boot ROM.
+	counter_offset = 0xabcc - cycles;
+	counter = 0xabcc;
+	tima = 0;
+	Register(TMA) = 0;
+	Register(TAC) = 0;
+}
+
+uint8_t &Timer::Register(uint16_t addr)
+{
+	return memory[addr];
+}
+
+uint8_t Timer::Register(uint16_t addr) const
+{
+	return memory[addr];
+}
+
+int Timer::Bit() const
+{
+	return CLOCK_BITS[Register(TAC) & 0x03];
+}
+
+bool Timer::Signal() const
+{
+	return (Register(TAC) & 0x04) && ((counter >> Bit()) & 1);
+}
+
+void Timer::Advance(uint64_t cycles)
+{
+	uint64_t now = cycles + counter_offset;
+	if(Register(TAC) & 0x04)
+	{
+		// One falling edge each time the counter passes a multiple of twice the bit.
+		int shift = Bit() + 1;
+		Increment((now >> shift) - (counter >> shift));
+	}
+	counter = now;
+}
+
+void Timer::Increment(uint64_t count)
+{
+	while(count >= 0x100u - tima)
+	{
+		count -= 0x100u - tima;
+		tima = Register(TMA);
+		Register(IF) |= INTERRUPT_TIMER;
+	}
+	tima += (uint8_t) count;
+}
+
+uint64_t Timer::NextOverflow() const
+{
+	if(!(Register(TAC) & 0x04))
+	{
+		return NEVER;
+	}
+	int shift = Bit() + 1;
+	uint64_t edge = ((counter >> shift) + (0x100u - tima)) << shift;
+	return edge - counter_offset;
+}
+
+uint8_t Timer::Read(uint16_t addr, uint64_t cycles)
+{
+	Advance(cycles);
+	switch(addr)
+	{
+	case DIV:
+		return (uint8_t) (counter >> 8);
+	case TIMA:
+		return tima;
+	case TMA:
+		return Register(TMA);
+	default:
+		return Register(TAC) | 0xf8;
+	}
+}
+
+void Timer::Write(uint16_t addr, uint8_t data, uint64_t cycles)
+{
+	Advance(cycles);
+	bool signal = Signal();
+	switch(addr)
+	{
+	case DIV:
+		// Any write clears the whole counter.
+		counter_offset += 0x10000 - (counter & 0xffff);
+		counter = cycles + counter_offset;
+		break;
+	case TIMA:
+		tima = data;
+		return;
+	case TMA:
+		Register(TMA) = data;
+		return;
+	default:
+		Register(TAC) = data & 0x07;
+		break;
+	}
+	// Clearing the counter or changing TAC can pull the clock input low, which TIMA
+	// counts like any other falling edge.
+	if(signal && !Signal())
+	{
+		Increment(1);
+	}
+}
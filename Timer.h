@@ -0,0 +1,66 @@
+/*
+	Copyright (c) 2020 Paul Espina
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+/*
+	Timer registers DIV, TIMA, TMA and TAC at 0xff04-0xff07.
+	Nothing is counted per T-state. DIV is the top byte of a 16-bit counter derived
+	from the cycle count, TIMA is brought up to date from the falling edges of the
+	counter bit TAC selects whenever it is read or written, and only its next
+	overflow has to be scheduled.
+	TMA and TAC are kept in the CPU's memory, the interrupt is requested in IF.
+*/
+class Timer
+{
+public:
+	static constexpr uint64_t NEVER = UINT64_MAX;
+	// memory is the 64 KiB address space, TMA and TAC in it are set by Reset.
+	Timer(uint8_t *memory);
+	// State after the boot ROM at cycles.
+	void Reset(uint64_t cycles);
+	// Counts TIMA up to cycles, reloading it and requesting the interrupt on overflow.
+	void Advance(uint64_t cycles);
+	// Cycle TIMA next overflows at, NEVER while TAC stops it.
+	uint64_t NextOverflow() const;
+	// Register 0xff04-0xff07 at cycles.
+	uint8_t Read(uint16_t addr, uint64_t cycles);
+	// Write to 0xff04-0xff07 at cycles, NextOverflow may change.
+	void Write(uint16_t addr, uint8_t data, uint64_t cycles);
+private:
+	uint8_t *memory;
+	// Added to the cycle count to give the counter, grows when DIV is reset.
+	uint64_t counter_offset;
+	// Counter value TIMA is up to date with.
+	uint64_t counter;
+	uint8_t tima;
+	uint8_t &Register(uint16_t addr);
+	uint8_t Register(uint16_t addr) const;
+	// Counter bit whose falling edges TIMA counts.
+	int Bit() const;
+	// TIMA's clock input, the selected bit of counter gated by TAC's enable bit.
+	bool Signal() const;
+	// Adds count to TIMA.
+	void Increment(uint64_t count);
+};
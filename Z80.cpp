@@ -21,41 +21,116 @@
 */
 
 #include "Z80.h"
+#include "JIT.h"
+#include "Mappers.h"
+#include "RomImage.h"
+#include "RomRegistry.h"
+#include "SaveRam.h"
 
-#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
 
-Z80::Z80()
+constexpr uint16_t IF = 0xff0f;
+constexpr uint16_t IE = 0xffff;
+
+// VBlank, STAT, timer, serial and joypad, in order of priority.
+constexpr uint8_t INTERRUPTS = 0x1f;
+constexpr uint16_t INTERRUPT_VECTORS = 0x40;
+constexpr uint32_t INTERRUPT_CYCLES = 20;
+constexpr uint8_t INTERRUPTS_IME_DELAY = 0x80;
+constexpr uint8_t INTERRUPTS_HALTED = 0x40;
+constexpr uint8_t INTERRUPT_TIMER = 0x04;
+constexpr uint8_t INTERRUPT_JOYPAD = 0x10;
+
+// Byte of a register pair holding the high register, in host byte order.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+constexpr int REGISTER_HI_BYTE = 0;
+#else
+constexpr int REGISTER_HI_BYTE = 1;
+#endif
+
+Z80::Z80() : ppu(memory, screen), timer(&memory[0])
 {
 	IME = false;
+	ime_delay = false;
+	halted = false;
+	stopped = false;
+	run_end = 0;
+	interrupts = 0;
 	memset(&registers, 0, sizeof(registers));
+	memset(&pending_flags, 0, sizeof(pending_flags));
+	flags_pending = false;
 	sp = 0;
 	pc = 0;
-	memset(&cartridge, 0, sizeof(cartridge));
+	rom = RomRegistry::Acquire(RomImage::FromBytes(nullptr, 0));
+	cartridge = rom->Data();
+	rom_banks = (uint32_t) (rom->Size() / 0x4000);
+	sram = SaveRam::Create(0x2000);
+	ram_banks = 1;
+	battery = false;
+	frames_since_flush = 0;
 	memset(&memory, 0, sizeof(memory));
 	memset(&screen, 0, sizeof(screen));
+	total_cycles = 0;
+	ppu_synced = 0;
 	cycle_count = 0;
+	frame_overshoot = 0;
+	cartridgeType = CartridgeType::ROM;
+	mapper_write = &WriteROM<RomOnly>;
+#if Z80_JIT
+	jit_enabled = false;
+	jit_verify = false;
+	EnableJIT(true);
+#endif
+	code_dirty = false;
+	running_block = nullptr;
+	block_exit = false;
+	polling_skip = true;
 	Init();
 }
 
-bool Z80::LoadCartridge(std::string path)
+Z80::~Z80()
+{
+}
+
+bool Z80::LoadCartridge(std::string path, bool save)
 {
-	std::ifstream file(path, std::ifstream::binary | std::ifstream::in);
-	if(file.is_open())
+	std::shared_ptr<const RomImage> image = RomRegistry::Acquire(path);
+	if(image == nullptr)
 	{
 		return false;
 	}
-	file.seekg(0, std::ios::end);
-	std::streamoff length = file.tellg();
-	file.seekg(0, std::ios::beg);
-	std::vector<char> result((unsigned int) length);
-	file.read(&result[0], length);
-	for(size_t i = 0, size = result.size(); i < size; i++)
+	InsertCartridge(image);
+	if(save && battery)
 	{
-		cartridge[i] = (uint8_t) result[i];
+		size_t separator = path.find_last_of("/\\");
+		size_t extension = path.find_last_of('.');
+		if(extension == std::string::npos || (separator != std::string::npos && extension < separator))
+		{
+			extension = path.size();
+		}
+		sram = SaveRam::Open(path.substr(0, extension) + ".sav", ram_banks * 0x2000);
+		MapMemory();
 	}
 	return true;
 }
 
+void Z80::InsertCartridge(std::shared_ptr<const RomImage> image)
+{
+	rom = std::move(image);
+	cartridge = rom->Data();
+	rom_banks = (uint32_t) (rom->Size() / 0x4000);
+	LoadInfo();
+	sram = SaveRam::Create(ram_banks * 0x2000);
+#if Z80_BLOCK_CACHE
+	rom_blocks.clear();
+	InvalidateBlocks();
+	polling_loops.clear();
+#endif
+	MapMemory();
+}
+
 void Z80::LoadInfo()
 {
 	switch(cartridge[0x0147])
@@ -72,91 +147,343 @@ void Z80::LoadInfo()
 	case 6:
 		cartridgeType = CartridgeType::MBC2;
 		break;
+	case 0x0f:
+	case 0x10:
+	case 0x11:
+	case 0x12:
+	case 0x13:
+		cartridgeType = CartridgeType::MBC3;
+		break;
+	case 0x19:
+	case 0x1a:
+	case 0x1b:
+	case 0x1c:
+	case 0x1d:
+	case 0x1e:
+		cartridgeType = CartridgeType::MBC5;
+		break;
 	default:
 		cartridgeType = CartridgeType::OTHER;
 	}
+	switch(cartridgeType)
+	{
+	case CartridgeType::ROM:
+		mapper_write = &WriteROM<RomOnly>;
+		break;
+	case CartridgeType::MBC2:
+		mapper_write = &WriteROM<MBC2>;
+		break;
+	case CartridgeType::MBC3:
+		mapper_write = &WriteROM<MBC3>;
+		break;
+	case CartridgeType::MBC5:
+		mapper_write = &WriteROM<MBC5>;
+		break;
+	default:
+		mapper_write = &WriteROM<MBC1>;
+	}
+	switch(cartridge[0x0149])
+	{
+	case 3:
+		ram_banks = 4;
+		break;
+	case 4:
+		ram_banks = 16;
+		break;
+	case 5:
+		ram_banks = 8;
+		break;
+	default:
+		ram_banks = 1;
+	}
+	switch(cartridge[0x0147])
+	{
+	case 0x03:
+	case 0x06:
+	case 0x09:
+	case 0x0d:
+	case 0x0f:
+	case 0x10:
+	case 0x13:
+	case 0x1b:
+	case 0x1e:
+	case 0xff:
+		battery = true;
+		break;
+	default:
+		battery = false;
+	}
+}
+
+template<class Mapper>
+void Z80::WriteROM(Z80 &cpu, uint16_t addr, uint8_t data)
+{
+	uint16_t rom_bank = cpu.rom_bank;
+	uint8_t ram_bank = cpu.ram_bank;
+	bool ram_enabled = cpu.ram_enabled;
+	Mapper::Write(cpu, addr, data);
+	if(cpu.ram_enabled != ram_enabled || cpu.ram_bank != ram_bank)
+	{
+		cpu.MapMemory();
+#if Z80_BLOCK_CACHE
+		// Blocks in 0xa000-0xbfff were decoded from the other mapping.
+		cpu.code_dirty = true;
+		cpu.block_exit = true;
+#endif
+	}
+	else if(cpu.rom_bank != rom_bank)
+	{
+		cpu.MapROM();
+	}
+#if Z80_BLOCK_CACHE
+	if(cpu.rom_bank != rom_bank && cpu.pc >= 0x4000 && cpu.pc < 0x8000)
+	{
+		// The rest of the running block was decoded from the old bank.
+		cpu.code_dirty = true;
+		cpu.block_exit = true;
+	}
+#endif
 }
 
 void Z80::Init()
 {
 	registers[AF] = 0x01b0;
+	DiscardFlags();
 	registers[BC] = 0x0013;
 	registers[DE] = 0x00d8;
 	registers[HL] = 0x014d;
 	sp = 0xfffe;
 	pc = 0x100;
+	// The render thread draws into screen from its log until it has caught up.
+	ppu.Sync();
 	memset(&memory, 0, sizeof(memory));
 	memset(&screen, 0, sizeof(screen));
+	// LCD registers as left by the boot ROM.
+	memory[0xff40] = 0x91;
+	memory[0xff47] = 0xfc;
+	memory[0xff48] = 0xff;
+	memory[0xff49] = 0xff;
+	ppu.Reset();
+	SchedulePPU();
+	timer.Reset(total_cycles);
+	ScheduleTimer();
+	UpdateInterrupts();
+	rom_bank = 1;
+	ram_bank = 0;
+	ram_enabled = false;
+	rom_ram_mode = false;
+#if Z80_BLOCK_CACHE
+	rom_blocks.clear();
+	InvalidateBlocks();
+	polling_loops.clear();
+#endif
+	MapMemory();
 }
 
 uint8_t Z80::ReadMem(uint16_t addr)
 {
-	if(addr >= 0 && addr <= 0xbfff)
+	const uint8_t *page = read_pages[addr >> 8];
+	if(page != nullptr)
 	{
-		return memory[addr];
+		return page[addr & 0xff];
 	}
-	return 0;
+	return ReadSlow(addr);
 }
 
 void Z80::WriteMem(uint16_t addr, uint8_t data)
+{
+	uint8_t *page = write_pages[addr >> 8];
+	if(page != nullptr)
+	{
+		page[addr & 0xff] = data;
+		return;
+	}
+	WriteSlow(addr, data);
+}
+
+uint8_t Z80::ReadSlow(uint16_t addr)
+{
+	if(addr >= 0xa000 && addr < 0xc000)
+	{
+		// RAM disabled, or a clock register mapped over it.
+		return ram_enabled && ClockMapped() ? rtc.Read(ram_bank) : 0xff;
+	}
+	if(addr >= 0xff04 && addr <= 0xff07)
+	{
+		return timer.Read(addr, Now());
+	}
+	return memory[addr];
+}
+
+void Z80::WriteSlow(uint16_t addr, uint8_t data)
 {
 	if(addr < 0x8000)
 	{
-		if(addr >= 0 && addr < 0x2000)
+		mapper_write(*this, addr, data);
+		return;
+	}
+	if(addr >= 0xe000 && addr < 0xfe00)
+	{
+		addr -= 0x2000;
+	}
+#if Z80_BLOCK_CACHE
+	if(code_map[(addr - 0x8000) >> 3] & (1 << (addr & 7)))
+	{
+		code_dirty = true;
+		block_exit = true;
+	}
+#endif
+	if(addr < 0xa000)
+	{
+		ppu.WriteVRAM(addr, data);
+		return;
+	}
+	if(addr >= 0xa000 && addr < 0xc000)
+	{
+		if(ram_enabled && ClockMapped())
 		{
-			(data & 0x00ff) == 0x0a ? ram_enabled = true : ram_enabled = false;
+			rtc.Write(ram_bank, data, Now());
 		}
-		else if(addr >= 0x2000 && addr < 0x4000)
+		if(!ram_enabled || ClockMapped())
 		{
-			if(cartridgeType == CartridgeType::MBC2)
-			{
-				rom_bank = data & 0xf;
-			}
-			else
-			{
-				data &= 0x1f;
-				rom_bank &= 0xc0;
-				rom_bank |= data;
-			}
-			if(rom_bank == 0)
-			{
-				rom_bank = 1;
-			}
+			return;
 		}
-		else if(addr >= 0x4000 && addr < 0x6000)
+		// First write to the page since the last FlushSave, later ones take the page table.
+		size_t offset = (ram_bank & (ram_banks - 1)) * 0x2000 + (addr - 0xa000);
+		sram->Data()[offset] = data;
+		sram->MarkDirty(offset);
+#if Z80_BLOCK_CACHE
+		if(HasCode(addr >> 8))
 		{
-			ram_bank = 0;
-			if(rom_ram_mode == 1)
-			{
-				ram_bank = data &= 0x3;
-			}
-			else
-			{
-				data &= 0xc0;
-				rom_bank &= 0x1f;
-				rom_bank |= data;
-			}
+			return;
 		}
-		else if(addr >= 0x6000 && addr < 0x8000)
+#endif
+		write_pages[addr >> 8] = &sram->Data()[offset & ~(SaveRam::PAGE_SIZE - 1)];
+		return;
+	}
+	if(addr >= 0xfe00 && addr < 0xfea0)
+	{
+		ppu.WriteOAM(addr, data);
+		return;
+	}
+	if(addr >= 0xff00 && addr < 0xff80)
+	{
+		WriteIO(addr, data);
+		return;
+	}
+	memory[addr] = data;
+	if(addr == IE)
+	{
+		UpdateInterrupts();
+#if Z80_BLOCK_CACHE
+		// An interrupt it enables is taken after this instruction.
+		block_exit = true;
+#endif
+	}
+}
+
+void Z80::WriteIO(uint16_t addr, uint8_t data)
+{
+#if Z80_BLOCK_CACHE
+	block_exit = true;
+#endif
+	if(addr == 0xff46)
+	{
+		// OAM DMA, copied at once.
+		memory[addr] = data;
+		for(uint16_t i = 0; i < 0xa0; i++)
+		{
+			ppu.WriteOAM(0xfe00 + i, ReadMem((data << 8) + i));
+		}
+#if Z80_BLOCK_CACHE
+		if(HasCode(0xfe))
 		{
-			(data & 0x1) == 0 ? rom_ram_mode = 0 : rom_ram_mode = 1;
+			code_dirty = true;
 		}
+#endif
+		return;
 	}
-	else if((addr >= 0xe000) && (addr < 0xfe00))
+	if(addr >= 0xff04 && addr <= 0xff07)
 	{
-		memory[addr] = data;
-		WriteMem(addr - 0x2000, data);
+		timer.Write(addr, data, Now());
+		ScheduleTimer();
+		UpdateInterrupts();
+		return;
+	}
+	if(addr >= 0xff40 && addr <= 0xff4b)
+	{
+		// LCDC can switch the LCD and its timing on or off.
+		SyncPPU();
+		ppu.WriteRegister(addr, data);
+		SchedulePPU();
+		UpdateInterrupts();
+		return;
+	}
+	memory[addr] = data;
+	if(addr == IF)
+	{
+		UpdateInterrupts();
+	}
+}
+
+void Z80::MapMemory()
+{
+	for(int page = 0; page < 0x100; page++)
+	{
+		// Echo RAM mirrors 0xc000-0xddff.
+		uint8_t *base = &memory[(page >= 0xe0 && page < 0xfe ? page - 0x20 : page) << 8];
+		read_pages[page] = base;
+		// Writes to ROM go to the MBC registers, writes to tile data to the PPU's tile cache.
+		write_pages[page] = page < 0x98 ? nullptr : base;
+	}
+	for(int page = 0; page < 0x40; page++)
+	{
+		read_pages[page] = &cartridge[page << 8];
+	}
+	MapROM();
+	uint8_t *ram = sram->Data() + (ram_bank & (ram_banks - 1)) * 0x2000;
+	for(int page = 0xa0; page < 0xc0; page++)
+	{
+		uint8_t *base = ram + ((page - 0xa0) << 8);
+		bool mapped = ram_enabled && !ClockMapped();
+		read_pages[page] = mapped ? base : nullptr;
+		// Saved RAM takes WriteSlow once per page to mark it dirty.
+		write_pages[page] = mapped && (!sram->Persistent() || sram->Dirty(base - sram->Data())) ? base : nullptr;
 	}
-	else if(addr >= 0xa000 && addr < 0xc000)
+	// I/O registers share the last page with HRAM and IE.
+	read_pages[0xff] = nullptr;
+	write_pages[0xff] = nullptr;
+	if(ppu.Threaded())
 	{
-		if(ram_enabled)
+		// The render thread is sent every write to the tile maps and OAM.
+		for(int page = 0x98; page < 0xa0; page++)
 		{
-			memory[addr] = data;
+			write_pages[page] = nullptr;
 		}
+		write_pages[0xfe] = nullptr;
 	}
-	else
+#if Z80_BLOCK_CACHE
+	for(int page = 0x80; page < 0x100; page++)
 	{
-		memory[addr] = data;
+		if(HasCode(page))
+		{
+			ProtectCode(page << 8);
+		}
+	}
+#endif
+}
+
+bool Z80::ClockMapped() const
+{
+	return cartridgeType == CartridgeType::MBC3 && ram_bank >= 0x08;
+}
+
+void Z80::MapROM()
+{
+	const uint8_t *bank = &cartridge[(rom_bank & (rom_banks - 1)) * 0x4000];
+	for(int page = 0; page < 0x40; page++)
+	{
+		read_pages[0x40 + page] = bank + (page << 8);
 	}
 }
 
@@ -185,8 +512,17 @@ void Z80::SetLoRegister(uint16_t &reg, uint8_t data)
 	reg = hi | data;
 }
 
+template<Z80::Reg8 r>
+uint8_t &Z80::Register()
+{
+	constexpr int pair = (int) r / 2;
+	constexpr bool hi = (int) r % 2 == 0;
+	return reinterpret_cast<uint8_t *>(&registers[pair])[hi ? REGISTER_HI_BYTE : 1 - REGISTER_HI_BYTE];
+}
+
 void Z80::SetFlag(int bit, bool value)
 {
+	FlushFlags();
 	uint8_t f = GetLoRegister(registers[AF]);
 	uint8_t setter = 1 << (bit + 4);
 	if(value)
@@ -198,33 +534,382 @@ void Z80::SetFlag(int bit, bool value)
 		setter ^= 0xff;
 		f &= setter;
 	}
+	SetLoRegister(registers[AF], f);
 }
 
 bool Z80::GetFlag(int bit)
 {
-	uint8_t f = GetLoRegister(registers[AF]);
+	uint8_t f;
+#if Z80_LAZY_FLAGS
+	if(flags_pending)
+	{
+		if(bit == FLAG_Z)
+		{
+			return pending_flags.result == 0;
+		}
+		if(bit == FLAG_C)
+		{
+			return pending_flags.c;
+		}
+		f = ComputeFlags(pending_flags);
+	}
+	else
+#endif
+	{
+		f = GetLoRegister(registers[AF]);
+	}
 	uint8_t setter = 1 << (bit + 4);
 	return (f & setter) >> (bit + 4);
 }
 
+uint8_t Z80::ComputeFlags(const PendingFlags &flags)
+{
+	bool z = flags.result == 0;
+	bool n = false;
+	bool h = false;
+	switch(flags.op)
+	{
+	case FlagOp::ADD:
+		h = (flags.a & 0xf) + (flags.b & 0xf) + flags.carry > 0xf;
+		break;
+	case FlagOp::SUB:
+		n = true;
+		h = (flags.a & 0xf) < (flags.b & 0xf) + flags.carry;
+		break;
+	case FlagOp::AND:
+		h = true;
+		break;
+	case FlagOp::OR:
+		break;
+	case FlagOp::INC:
+		h = (flags.a & 0xf) == 0xf;
+		break;
+	case FlagOp::DEC:
+		n = true;
+		h = (flags.a & 0xf) == 0;
+		break;
+	}
+	return (z << (FLAG_Z + 4)) | (n << (FLAG_N + 4)) | (h << (FLAG_H + 4)) | (flags.c << (FLAG_C + 4));
+}
+
+void Z80::SetFlags(FlagOp op, uint8_t a, uint8_t b, uint8_t carry, uint8_t result, bool c)
+{
+	PendingFlags flags = {op, a, b, carry, result, c};
+#if Z80_LAZY_FLAGS
+	pending_flags = flags;
+	flags_pending = true;
+#else
+	SetLoRegister(registers[AF], ComputeFlags(flags));
+#endif
+}
+
+void Z80::DiscardFlags()
+{
+#if Z80_LAZY_FLAGS
+	flags_pending = false;
+#endif
+}
+
+void Z80::FlushFlags()
+{
+#if Z80_LAZY_FLAGS
+	if(flags_pending)
+	{
+		SetLoRegister(registers[AF], ComputeFlags(pending_flags));
+		flags_pending = false;
+	}
+#endif
+}
+
 void Z80::Cycle()
 {
+	if(cycle_count == 0)
+	{
+		cycle_count = Step();
+	}
 	if(cycle_count > 0)
 	{
-		uint8_t opcode = Fetch();
-		cycle_count = Decode(opcode);
+		cycle_count--;
+	}
+}
+
+uint32_t Z80::Step()
+{
+	uint64_t start = total_cycles;
+#if Z80_BLOCK_CACHE
+	// Polling iterations skipped after the block count in BLOCK_MAX_CYCLES too.
+	Tick(ExecuteBlock(total_cycles + BLOCK_MAX_CYCLES));
+#else
+	Tick(StepInstruction());
+#endif
+	// Interrupt handlers called and, while halted, time skipped count too.
+	return (uint32_t) (total_cycles - start);
+}
+
+Z80_FORCEINLINE void Z80::Tick(uint32_t cycles)
+{
+	total_cycles += cycles;
+	if(total_cycles >= scheduler.Next())
+	{
+		RunEvents();
+	}
+	if(interrupts != 0)
+	{
+		ServiceInterrupts();
+	}
+}
+
+void Z80::RunEvents()
+{
+	Scheduler::Event event;
+	while(scheduler.Pop(total_cycles, event))
+	{
+		switch(event)
+		{
+		case Scheduler::Event::PPU:
+			SyncPPU();
+			SchedulePPU();
+			break;
+		case Scheduler::Event::TIMER:
+			timer.Advance(total_cycles);
+			ScheduleTimer();
+			break;
+		default:
+			break;
+		}
+	}
+	UpdateInterrupts();
+}
+
+uint64_t Z80::Now() const
+{
+#if Z80_BLOCK_CACHE
+	if(running_block != nullptr)
+	{
+		// The instruction running is the last one starting at or before pc. Handlers move pc past
+		// their operands, only the last instruction of a block jumps, after its memory accesses.
+		const MicroOp *op = running_block->ops.data();
+		const MicroOp *last = op + running_block->ops.size() - 1;
+		uint64_t now = total_cycles;
+		for(; op != last && (op + 1)->pc <= pc; op++)
+		{
+			now += op->cycles;
+		}
+		return now;
+	}
+#endif
+	return total_cycles;
+}
+
+void Z80::SyncPPU()
+{
+	uint64_t now = Now();
+	ppu.Advance((uint32_t) (now - ppu_synced));
+	ppu_synced = now;
+}
+
+void Z80::SchedulePPU()
+{
+	ppu_synced = Now();
+	uint32_t cycles = ppu.CyclesToEvent();
+	if(cycles == PPU::NEVER)
+	{
+		scheduler.Cancel(Scheduler::Event::PPU);
+		return;
+	}
+	scheduler.Schedule(Scheduler::Event::PPU, ppu_synced + cycles);
+}
+
+void Z80::UpdateInterrupts()
+{
+	interrupts = (IME ? memory[IE] & memory[IF] & INTERRUPTS : 0) | (ime_delay ? INTERRUPTS_IME_DELAY : 0) |
+		(halted ? INTERRUPTS_HALTED : 0);
+}
+
+void Z80::ServiceInterrupts()
+{
+	if(ime_delay)
+	{
+		// The instruction after EI runs on its own, even where a block would follow,
+		// and cannot be interrupted. A DI there cancels the EI.
+		ime_delay = false;
+		IME = true;
+		uint32_t cycles = StepInstruction();
+		UpdateInterrupts();
+		Tick(cycles);
+		return;
+	}
+	if(halted)
+	{
+		Idle();
+		if(halted || interrupts == 0)
+		{
+			return;
+		}
+	}
+	// Lowest bit first, its flag is cleared and IME stays off until RETI or EI.
+	int bit = 0;
+	while(!(interrupts & (1 << bit)))
+	{
+		bit++;
+	}
+	memory[IF] &= ~(1 << bit);
+	IME = false;
+	interrupts = 0;
+	PUSH(pc);
+	pc = INTERRUPT_VECTORS + bit * 8;
+	total_cycles += INTERRUPT_CYCLES;
+	if(total_cycles >= scheduler.Next())
+	{
+		RunEvents();
+	}
+}
+
+void Z80::Idle()
+{
+	for(;;)
+	{
+		uint8_t wake = stopped ? memory[IF] & INTERRUPT_JOYPAD : memory[IE] & memory[IF] & INTERRUPTS;
+		if(wake != 0)
+		{
+			break;
+		}
+		// Only an enabled interrupt wakes the CPU, events that cannot request one are run late,
+		// all at once. STOP waits for the joypad, which nothing requests.
+		uint8_t enabled = stopped ? 0 : memory[IE];
+		uint64_t next = Scheduler::NEVER;
+		uint32_t cycles = ppu.CyclesToInterrupt(enabled);
+		if(cycles != PPU::NEVER)
+		{
+			next = ppu_synced + cycles;
+		}
+		if(enabled & INTERRUPT_TIMER)
+		{
+			next = std::min(next, scheduler.When(Scheduler::Event::TIMER));
+		}
+		if(next > run_end)
+		{
+			// HALT runs again from the next RunCycles.
+			if(total_cycles < run_end)
+			{
+				total_cycles = run_end;
+				RunEvents();
+			}
+			return;
+		}
+		total_cycles = next;
+		RunEvents();
+	}
+	// Past HALT, or STOP and the byte after it.
+	pc += stopped ? 2 : 1;
+	halted = false;
+	stopped = false;
+	UpdateInterrupts();
+}
+
+void Z80::ScheduleTimer()
+{
+	uint64_t when = timer.NextOverflow();
+	if(when == Timer::NEVER)
+	{
+		scheduler.Cancel(Scheduler::Event::TIMER);
+		return;
+	}
+	scheduler.Schedule(Scheduler::Event::TIMER, when);
+}
+
+uint32_t Z80::StepInstruction()
+{
+	uint8_t opcode = Fetch();
+	return Dispatch(opcode);
+}
+
+uint32_t Z80::RunInstruction()
+{
+	uint64_t start = total_cycles;
+	Tick(StepInstruction());
+	return (uint32_t) (total_cycles - start);
+}
+
+uint32_t Z80::RunCycles(uint32_t cycles)
+{
+	uint64_t start = total_cycles;
+	uint64_t end = start + cycles;
+	run_end = end;
+	while(total_cycles < end)
+	{
+#if Z80_BLOCK_CACHE
+		Tick(ExecuteBlock(end));
+#else
+		Tick(StepInstruction());
+#endif
+	}
+	return (uint32_t) (total_cycles - start);
+}
+
+uint32_t Z80::RunFrame()
+{
+	uint32_t target = FRAME_CYCLES - frame_overshoot;
+	uint32_t ran = RunCycles(target);
+	frame_overshoot = ran - target;
+	if(++frames_since_flush >= SAVE_FLUSH_FRAMES)
+	{
+		FlushSave();
+	}
+	return ran;
+}
+
+void Z80::SetRendering(bool enabled)
+{
+	ppu.SetRendering(enabled);
+}
+
+void Z80::SetFrameBuffer(void *pixels, size_t pitch, PixelFormat format)
+{
+	if(pixels == nullptr)
+	{
+		ppu.SetOutput(screen, PPU::WIDTH, PixelFormat::INDEXED2);
+		return;
+	}
+	ppu.SetOutput(pixels, pitch, format);
+}
+
+Renderer::Damage Z80::LastDamage() const
+{
+	return ppu.LastDamage();
+}
+
+void Z80::EnableRenderThread(bool enabled)
+{
+	ppu.SetThreaded(enabled);
+	MapMemory();
+}
+
+void Z80::SyncScreen()
+{
+	ppu.Sync();
+}
+
+void Z80::FlushSave()
+{
+	frames_since_flush = 0;
+	if(sram->Persistent())
+	{
+		sram->Flush();
+		// Dirty was cleared, send the next write to each page through WriteSlow again.
+		MapMemory();
 	}
-	cycle_count--;
 }
 
 uint8_t Z80::Fetch()
 {
-	uint8_t opcode = memory[pc];
+	uint8_t opcode = ReadMem(pc);
 	pc++;
 	return opcode;
 }
 
-uint8_t Z80::Decode(uint8_t opcode)
+// Forced inline so every Execute<opcode> folds the switch down to one case.
+Z80_FORCEINLINE uint8_t Z80::Decode(uint8_t opcode)
 {
 	uint8_t count = 0;
 	uint16_t nn;
@@ -237,13 +922,12 @@ uint8_t Z80::Decode(uint8_t opcode)
 		break;
 	case 0x01:
 		nn = Fetch();
-		nn <<= 8;
-		nn |= Fetch();
+		nn |= Fetch() << 8;
 		LD16(registers[BC], nn);
 		count = 12;
 		break;
 	case 0x02:
-		LD8(registers[BC], GetHiRegister(registers[AF]));
+		LD8(registers[BC], Register<Reg8::A>());
 		count = 8;
 		break;
 	case 0x03:
@@ -251,16 +935,16 @@ uint8_t Z80::Decode(uint8_t opcode)
 		count = 8;
 		break;
 	case 0x04:
-		INC8(registers[BC], "hi");
+		INC8<Reg8::B>();
 		count = 4;
 		break;
 	case 0x05:
-		DEC8(registers[BC], "hi");
+		DEC8<Reg8::B>();
 		count = 4;
 		break;
 	case 0x06:
 		n = Fetch();
-		LD8(registers[BC], "hi", n);
+		LD8<Reg8::B>(n);
 		count = 8;
 		break;
 	case 0x07:
@@ -269,10 +953,9 @@ uint8_t Z80::Decode(uint8_t opcode)
 		break;
 	case 0x08:
 		nn = Fetch();
-		nn <<= 8;
-		nn |= Fetch();
-		LD8(nn++, GetHiRegister(sp));
-		LD8(nn, GetLoRegister(sp));
+		nn |= Fetch() << 8;
+		LD8(nn++, GetLoRegister(sp));
+		LD8(nn, GetHiRegister(sp));
 		count = 20;
 		break;
 	case 0x09:
@@ -281,7 +964,7 @@ uint8_t Z80::Decode(uint8_t opcode)
 		break;
 	case 0x0a:
 		n = ReadMem(registers[BC]);
-		LD8(registers[AF], "hi", n);
+		LD8<Reg8::A>(n);
 		count = 8;
 		break;
 	case 0x0b:
@@ -289,16 +972,16 @@ uint8_t Z80::Decode(uint8_t opcode)
 		count = 8;
 		break;
 	case 0x0c:
-		INC8(registers[BC], "lo");
+		INC8<Reg8::C>();
 		count = 4;
 		break;
 	case 0x0d:
-		DEC8(registers[BC], "lo");
+		DEC8<Reg8::C>();
 		count = 4;
 		break;
 	case 0x0e:
 		n = Fetch();
-		LD8(registers[BC], "lo", n);
+		LD8<Reg8::C>(n);
 		count = 8;
 		break;
 	case 0x0f:
@@ -312,13 +995,12 @@ uint8_t Z80::Decode(uint8_t opcode)
 		break;
 	case 0x11:
 		nn = Fetch();
-		nn <<= 8;
-		nn |= Fetch();
+		nn |= Fetch() << 8;
 		LD16(registers[DE], nn);
 		count = 12;
 		break;
 	case 0x12:
-		LD8(registers[DE], GetHiRegister(registers[AF]));
+		LD8(registers[DE], Register<Reg8::A>());
 		count = 8;
 		break;
 	case 0x13:
@@ -326,16 +1008,16 @@ uint8_t Z80::Decode(uint8_t opcode)
 		count = 8;
 		break;
 	case 0x14:
-		INC8(registers[DE], "hi");
+		INC8<Reg8::D>();
 		count = 4;
 		break;
 	case 0x15:
-		DEC8(registers[DE], "hi");
+		DEC8<Reg8::D>();
 		count = 4;
 		break;
 	case 0x16:
 		n = Fetch();
-		LD8(registers[DE], "hi", n);
+		LD8<Reg8::D>(n);
 		count = 8;
 		break;
 	case 0x17:
@@ -353,7 +1035,7 @@ uint8_t Z80::Decode(uint8_t opcode)
 		break;
 	case 0x1a:
 		n = ReadMem(registers[DE]);
-		LD8(registers[AF], "hi", n);
+		LD8<Reg8::A>(n);
 		count = 8;
 		break;
 	case 0x1b:
@@ -361,16 +1043,16 @@ uint8_t Z80::Decode(uint8_t opcode)
 		count = 8;
 		break;
 	case 0x1c:
-		INC8(registers[DE], "lo");
+		INC8<Reg8::E>();
 		count = 4;
 		break;
 	case 0x1d:
-		DEC8(registers[DE], "lo");
+		DEC8<Reg8::E>();
 		count = 4;
 		break;
 	case 0x1e:
 		n = Fetch();
-		LD8(registers[DE], "lo", n);
+		LD8<Reg8::E>(n);
 		count = 8;
 		break;
 	case 0x1f:
@@ -385,13 +1067,12 @@ uint8_t Z80::Decode(uint8_t opcode)
 		break;
 	case 0x21:
 		nn = Fetch();
-		nn <<= 8;
-		nn |= Fetch();
+		nn |= Fetch() << 8;
 		LD16(registers[HL], nn);
 		count = 12;
 		break;
 	case 0x22:
-		LD8(registers[HL], GetHiRegister(registers[AF]));
+		LD8(registers[HL], Register<Reg8::A>());
 		INC16(registers[HL]);
 		count = 8;
 		break;
@@ -400,16 +1081,16 @@ uint8_t Z80::Decode(uint8_t opcode)
 		count = 8;
 		break;
 	case 0x24:
-		INC8(registers[HL], "hi");
+		INC8<Reg8::H>();
 		count = 4;
 		break;
 	case 0x25:
-		DEC8(registers[HL], "hi");
+		DEC8<Reg8::H>();
 		count = 4;
 		break;
 	case 0x26:
 		n = Fetch();
-		LD8(registers[HL], "hi", n);
+		LD8<Reg8::H>(n);
 		count = 8;
 		break;
 	case 0x27:
@@ -427,7 +1108,7 @@ uint8_t Z80::Decode(uint8_t opcode)
 		break;
 	case 0x2a:
 		n = ReadMem(registers[HL]);
-		LD8(registers[AF], "hi", n);
+		LD8<Reg8::A>(n);
 		INC16(registers[HL]);
 		count = 8;
 		break;
@@ -436,16 +1117,16 @@ uint8_t Z80::Decode(uint8_t opcode)
 		count = 8;
 		break;
 	case 0x2c:
-		INC8(registers[HL], "lo");
+		INC8<Reg8::L>();
 		count = 4;
 		break;
 	case 0x2d:
-		DEC8(registers[HL], "lo");
+		DEC8<Reg8::L>();
 		count = 4;
 		break;
 	case 0x2e:
 		n = Fetch();
-		LD8(registers[HL], "lo", n);
+		LD8<Reg8::L>(n);
 		count = 8;
 		break;
 	case 0x2f:
@@ -460,13 +1141,12 @@ uint8_t Z80::Decode(uint8_t opcode)
 		break;
 	case 0x31:
 		nn = Fetch();
-		nn <<= 8;
-		nn |= Fetch();
+		nn |= Fetch() << 8;
 		LD16(sp, nn);
 		count = 12;
 		break;
 	case 0x32:
-		LD8(registers[HL], GetHiRegister(registers[AF]));
+		LD8(registers[HL], Register<Reg8::A>());
 		DEC16(registers[HL]);
 		count = 8;
 		break;
@@ -502,7 +1182,7 @@ uint8_t Z80::Decode(uint8_t opcode)
 		break;
 	case 0x3a:
 		n = ReadMem(registers[HL]);
-		LD8(registers[AF], "hi", n);
+		LD8<Reg8::A>(n);
 		DEC16(registers[HL]);
 		count = 8;
 		break;
@@ -511,16 +1191,16 @@ uint8_t Z80::Decode(uint8_t opcode)
 		count = 8;
 		break;
 	case 0x3c:
-		INC8(registers[AF], "hi");
+		INC8<Reg8::A>();
 		count = 4;
 		break;
 	case 0x3d:
-		DEC8(registers[AF], "hi");
+		DEC8<Reg8::A>();
 		count = 4;
 		break;
 	case 0x3e:
 		n = Fetch();
-		LD8(registers[AF], "hi", n);
+		LD8<Reg8::A>(n);
 		count = 8;
 		break;
 	case 0x3f:
@@ -529,228 +1209,228 @@ uint8_t Z80::Decode(uint8_t opcode)
 		break;
 	// 4x
 	case 0x40:
-		LD8(registers[BC], "hi", GetHiRegister(registers[BC]));
+		LD8<Reg8::B>(Register<Reg8::B>());
 		count = 4;
 		break;
 	case 0x41:
-		LD8(registers[BC], "hi", GetLoRegister(registers[BC]));
+		LD8<Reg8::B>(Register<Reg8::C>());
 		count = 4;
 		break;
 	case 0x42:
-		LD8(registers[BC], "hi", GetHiRegister(registers[DE]));
+		LD8<Reg8::B>(Register<Reg8::D>());
 		count = 4;
 		break;
 	case 0x43:
-		LD8(registers[BC], "hi", GetLoRegister(registers[DE]));
+		LD8<Reg8::B>(Register<Reg8::E>());
 		count = 4;
 		break;
 	case 0x44:
-		LD8(registers[BC], "hi", GetHiRegister(registers[HL]));
+		LD8<Reg8::B>(Register<Reg8::H>());
 		count = 4;
 		break;
 	case 0x45:
-		LD8(registers[BC], "hi", GetLoRegister(registers[HL]));
+		LD8<Reg8::B>(Register<Reg8::L>());
 		count = 4;
 		break;
 	case 0x46:
 		n = ReadMem(registers[HL]);
-		LD8(registers[BC], "hi", n);
+		LD8<Reg8::B>(n);
 		count = 8;
 		break;
 	case 0x47:
-		LD8(registers[BC], "hi", GetHiRegister(registers[AF]));
+		LD8<Reg8::B>(Register<Reg8::A>());
 		count = 4;
 		break;
 	case 0x48:
-		LD8(registers[BC], "lo", GetHiRegister(registers[BC]));
+		LD8<Reg8::C>(Register<Reg8::B>());
 		count = 4;
 		break;
 	case 0x49:
-		LD8(registers[BC], "lo", GetLoRegister(registers[BC]));
+		LD8<Reg8::C>(Register<Reg8::C>());
 		count = 4;
 		break;
 	case 0x4a:
-		LD8(registers[BC], "lo", GetHiRegister(registers[DE]));
+		LD8<Reg8::C>(Register<Reg8::D>());
 		count = 4;
 		break;
 	case 0x4b:
-		LD8(registers[BC], "lo", GetLoRegister(registers[DE]));
+		LD8<Reg8::C>(Register<Reg8::E>());
 		count = 4;
 		break;
 	case 0x4c:
-		LD8(registers[BC], "lo", GetHiRegister(registers[HL]));
+		LD8<Reg8::C>(Register<Reg8::H>());
 		count = 4;
 		break;
 	case 0x4d:
-		LD8(registers[BC], "lo", GetLoRegister(registers[HL]));
+		LD8<Reg8::C>(Register<Reg8::L>());
 		count = 4;
 		break;
 	case 0x4e:
 		n = ReadMem(registers[HL]);
-		LD8(registers[BC], "lo", n);
+		LD8<Reg8::C>(n);
 		count = 8;
 		break;
 	case 0x4f:
-		LD8(registers[BC], "lo", GetHiRegister(registers[AF]));
+		LD8<Reg8::C>(Register<Reg8::A>());
 		count = 4;
 		break;
 	// 5x
 	case 0x50:
-		LD8(registers[DE], "hi", GetHiRegister(registers[BC]));
+		LD8<Reg8::D>(Register<Reg8::B>());
 		count = 4;
 		break;
 	case 0x51:
-		LD8(registers[DE], "hi", GetLoRegister(registers[BC]));
+		LD8<Reg8::D>(Register<Reg8::C>());
 		count = 4;
 		break;
 	case 0x52:
-		LD8(registers[DE], "hi", GetHiRegister(registers[DE]));
+		LD8<Reg8::D>(Register<Reg8::D>());
 		count = 4;
 		break;
 	case 0x53:
-		LD8(registers[DE], "hi", GetLoRegister(registers[DE]));
+		LD8<Reg8::D>(Register<Reg8::E>());
 		count = 4;
 		break;
 	case 0x54:
-		LD8(registers[DE], "hi", GetHiRegister(registers[HL]));
+		LD8<Reg8::D>(Register<Reg8::H>());
 		count = 4;
 		break;
 	case 0x55:
-		LD8(registers[DE], "hi", GetLoRegister(registers[HL]));
+		LD8<Reg8::D>(Register<Reg8::L>());
 		count = 4;
 		break;
 	case 0x56:
 		n = ReadMem(registers[HL]);
-		LD8(registers[DE], "hi", n);
+		LD8<Reg8::D>(n);
 		count = 8;
 		break;
 	case 0x57:
-		LD8(registers[DE], "lo", GetHiRegister(registers[AF]));
+		LD8<Reg8::D>(Register<Reg8::A>());
 		count = 4;
 		break;
 	case 0x58:
-		LD8(registers[DE], "lo", GetHiRegister(registers[BC]));
+		LD8<Reg8::E>(Register<Reg8::B>());
 		count = 4;
 		break;
 	case 0x59:
-		LD8(registers[DE], "lo", GetLoRegister(registers[BC]));
+		LD8<Reg8::E>(Register<Reg8::C>());
 		count = 4;
 		break;
 	case 0x5a:
-		LD8(registers[DE], "lo", GetHiRegister(registers[DE]));
+		LD8<Reg8::E>(Register<Reg8::D>());
 		count = 4;
 		break;
 	case 0x5b:
-		LD8(registers[DE], "lo", GetLoRegister(registers[DE]));
+		LD8<Reg8::E>(Register<Reg8::E>());
 		count = 4;
 		break;
 	case 0x5c:
-		LD8(registers[DE], "lo", GetHiRegister(registers[HL]));
+		LD8<Reg8::E>(Register<Reg8::H>());
 		count = 4;
 		break;
 	case 0x5d:
-		LD8(registers[DE], "lo", GetLoRegister(registers[HL]));
+		LD8<Reg8::E>(Register<Reg8::L>());
 		count = 4;
 		break;
 	case 0x5e:
 		n = ReadMem(registers[HL]);
-		LD8(registers[DE], "lo", n);
+		LD8<Reg8::E>(n);
 		count = 8;
 		break;
 	case 0x5f:
-		LD8(registers[DE], "lo", GetHiRegister(registers[AF]));
+		LD8<Reg8::E>(Register<Reg8::A>());
 		count = 4;
 		break;
 	// 6x
 	case 0x60:
-		LD8(registers[HL], "hi", GetHiRegister(registers[BC]));
+		LD8<Reg8::H>(Register<Reg8::B>());
 		count = 4;
 		break;
 	case 0x61:
-		LD8(registers[HL], "hi", GetLoRegister(registers[BC]));
+		LD8<Reg8::H>(Register<Reg8::C>());
 		count = 4;
 		break;
 	case 0x62:
-		LD8(registers[HL], "hi", GetHiRegister(registers[DE]));
+		LD8<Reg8::H>(Register<Reg8::D>());
 		count = 4;
 		break;
 	case 0x63:
-		LD8(registers[HL], "hi", GetLoRegister(registers[DE]));
+		LD8<Reg8::H>(Register<Reg8::E>());
 		count = 4;
 		break;
 	case 0x64:
-		LD8(registers[HL], "hi", GetHiRegister(registers[HL]));
+		LD8<Reg8::H>(Register<Reg8::H>());
 		count = 4;
 		break;
 	case 0x65:
-		LD8(registers[HL], "hi", GetLoRegister(registers[HL]));
+		LD8<Reg8::H>(Register<Reg8::L>());
 		count = 4;
 		break;
 	case 0x66:
 		n = ReadMem(registers[HL]);
-		LD8(registers[HL], "hi", n);
+		LD8<Reg8::H>(n);
 		count = 8;
 		break;
 	case 0x67:
-		LD8(registers[HL], "lo", GetHiRegister(registers[AF]));
+		LD8<Reg8::H>(Register<Reg8::A>());
 		count = 4;
 		break;
 	case 0x68:
-		LD8(registers[HL], "lo", GetHiRegister(registers[BC]));
+		LD8<Reg8::L>(Register<Reg8::B>());
 		count = 4;
 		break;
 	case 0x69:
-		LD8(registers[HL], "lo", GetLoRegister(registers[BC]));
+		LD8<Reg8::L>(Register<Reg8::C>());
 		count = 4;
 		break;
 	case 0x6a:
-		LD8(registers[HL], "lo", GetHiRegister(registers[DE]));
+		LD8<Reg8::L>(Register<Reg8::D>());
 		count = 4;
 		break;
 	case 0x6b:
-		LD8(registers[HL], "lo", GetLoRegister(registers[DE]));
+		LD8<Reg8::L>(Register<Reg8::E>());
 		count = 4;
 		break;
 	case 0x6c:
-		LD8(registers[HL], "lo", GetHiRegister(registers[HL]));
+		LD8<Reg8::L>(Register<Reg8::H>());
 		count = 4;
 		break;
 	case 0x6d:
-		LD8(registers[HL], "lo", GetLoRegister(registers[HL]));
+		LD8<Reg8::L>(Register<Reg8::L>());
 		count = 4;
 		break;
 	case 0x6e:
 		n = ReadMem(registers[HL]);
-		LD8(registers[HL], "lo", n);
+		LD8<Reg8::L>(n);
 		count = 8;
 		break;
 	case 0x6f:
-		LD8(registers[HL], "lo", GetHiRegister(registers[AF]));
+		LD8<Reg8::L>(Register<Reg8::A>());
 		count = 4;
 		break;
 	// 7x
 	case 0x70:
-		LD8(registers[HL], GetHiRegister(registers[BC]));
+		LD8(registers[HL], Register<Reg8::B>());
 		count = 8;
 		break;
 	case 0x71:
-		LD8(registers[HL], GetLoRegister(registers[BC]));
+		LD8(registers[HL], Register<Reg8::C>());
 		count = 8;
 		break;
 	case 0x72:
-		LD8(registers[HL], GetHiRegister(registers[DE]));
+		LD8(registers[HL], Register<Reg8::D>());
 		count = 8;
 		break;
 	case 0x73:
-		LD8(registers[HL], GetLoRegister(registers[DE]));
+		LD8(registers[HL], Register<Reg8::E>());
 		count = 8;
 		break;
 	case 0x74:
-		LD8(registers[HL], GetHiRegister(registers[HL]));
+		LD8(registers[HL], Register<Reg8::H>());
 		count = 8;
 		break;
 	case 0x75:
-		LD8(registers[HL], GetLoRegister(registers[HL]));
+		LD8(registers[HL], Register<Reg8::L>());
 		count = 8;
 		break;
 	case 0x76:
@@ -758,65 +1438,65 @@ uint8_t Z80::Decode(uint8_t opcode)
 		count = 4;
 		break;
 	case 0x77:
-		LD8(registers[HL], GetHiRegister(registers[AF]));
+		LD8(registers[HL], Register<Reg8::A>());
 		count = 8;
 		break;
 	case 0x78:
-		LD8(registers[AF], "hi", GetHiRegister(registers[BC]));
+		LD8<Reg8::A>(Register<Reg8::B>());
 		count = 4;
 		break;
 	case 0x79:
-		LD8(registers[AF], "hi", GetLoRegister(registers[BC]));
+		LD8<Reg8::A>(Register<Reg8::C>());
 		count = 4;
 		break;
 	case 0x7a:
-		LD8(registers[AF], "hi", GetHiRegister(registers[DE]));
+		LD8<Reg8::A>(Register<Reg8::D>());
 		count = 4;
 		break;
 	case 0x7b:
-		LD8(registers[AF], "hi", GetLoRegister(registers[DE]));
+		LD8<Reg8::A>(Register<Reg8::E>());
 		count = 4;
 		break;
 	case 0x7c:
-		LD8(registers[AF], "hi", GetHiRegister(registers[HL]));
+		LD8<Reg8::A>(Register<Reg8::H>());
 		count = 4;
 		break;
 	case 0x7d:
-		LD8(registers[AF], "hi", GetLoRegister(registers[HL]));
+		LD8<Reg8::A>(Register<Reg8::L>());
 		count = 4;
 		break;
 	case 0x7e:
 		n = ReadMem(registers[HL]);
-		LD8(registers[AF], "hi", n);
+		LD8<Reg8::A>(n);
 		count = 8;
 		break;
 	case 0x7f:
-		LD8(registers[AF], "hi", GetHiRegister(registers[AF]));
+		LD8<Reg8::A>(Register<Reg8::A>());
 		count = 4;
 		break;
 	// 8x
 	case 0x80:
-		ADD8(GetHiRegister(registers[BC]), false);
+		ADD8(Register<Reg8::B>(), false);
 		count = 4;
 		break;
 	case 0x81:
-		ADD8(GetLoRegister(registers[BC]), false);
+		ADD8(Register<Reg8::C>(), false);
 		count = 4;
 		break;
 	case 0x82:
-		ADD8(GetHiRegister(registers[DE]), false);
+		ADD8(Register<Reg8::D>(), false);
 		count = 4;
 		break;
 	case 0x83:
-		ADD8(GetLoRegister(registers[DE]), false);
+		ADD8(Register<Reg8::E>(), false);
 		count = 4;
 		break;
 	case 0x84:
-		ADD8(GetHiRegister(registers[HL]), false);
+		ADD8(Register<Reg8::H>(), false);
 		count = 4;
 		break;
 	case 0x85:
-		ADD8(GetLoRegister(registers[HL]), false);
+		ADD8(Register<Reg8::L>(), false);
 		count = 4;
 		break;
 	case 0x86:
@@ -825,31 +1505,31 @@ uint8_t Z80::Decode(uint8_t opcode)
 		count = 8;
 		break;
 	case 0x87:
-		ADD8(GetHiRegister(registers[AF]), false);
+		ADD8(Register<Reg8::A>(), false);
 		count = 4;
 		break;
 	case 0x88:
-		ADD8(GetHiRegister(registers[BC]), true);
+		ADD8(Register<Reg8::B>(), true);
 		count = 4;
 		break;
 	case 0x89:
-		ADD8(GetLoRegister(registers[BC]), true);
+		ADD8(Register<Reg8::C>(), true);
 		count = 4;
 		break;
 	case 0x8a:
-		ADD8(GetHiRegister(registers[DE]), true);
+		ADD8(Register<Reg8::D>(), true);
 		count = 4;
 		break;
 	case 0x8b:
-		ADD8(GetLoRegister(registers[DE]), true);
+		ADD8(Register<Reg8::E>(), true);
 		count = 4;
 		break;
 	case 0x8c:
-		ADD8(GetHiRegister(registers[HL]), true);
+		ADD8(Register<Reg8::H>(), true);
 		count = 4;
 		break;
 	case 0x8d:
-		ADD8(GetLoRegister(registers[HL]), true);
+		ADD8(Register<Reg8::L>(), true);
 		count = 4;
 		break;
 	case 0x8e:
@@ -858,32 +1538,32 @@ uint8_t Z80::Decode(uint8_t opcode)
 		count = 8;
 		break;
 	case 0x8f:
-		ADD8(GetHiRegister(registers[AF]), true);
+		ADD8(Register<Reg8::A>(), true);
 		count = 4;
 		break;
 	// 9x
 	case 0x90:
-		SUB(GetHiRegister(registers[BC]), false);
+		SUB(Register<Reg8::B>(), false);
 		count = 4;
 		break;
 	case 0x91:
-		SUB(GetLoRegister(registers[BC]), false);
+		SUB(Register<Reg8::C>(), false);
 		count = 4;
 		break;
 	case 0x92:
-		SUB(GetHiRegister(registers[DE]), false);
+		SUB(Register<Reg8::D>(), false);
 		count = 4;
 		break;
 	case 0x93:
-		SUB(GetLoRegister(registers[DE]), false);
+		SUB(Register<Reg8::E>(), false);
 		count = 4;
 		break;
 	case 0x94:
-		SUB(GetHiRegister(registers[HL]), false);
+		SUB(Register<Reg8::H>(), false);
 		count = 4;
 		break;
 	case 0x95:
-		SUB(GetLoRegister(registers[HL]), false);
+		SUB(Register<Reg8::L>(), false);
 		count = 4;
 		break;
 	case 0x96:
@@ -892,31 +1572,31 @@ uint8_t Z80::Decode(uint8_t opcode)
 		count = 8;
 		break;
 	case 0x97:
-		SUB(GetHiRegister(registers[AF]), false);
+		SUB(Register<Reg8::A>(), false);
 		count = 4;
 		break;
 	case 0x98:
-		SUB(GetHiRegister(registers[BC]), true);
+		SUB(Register<Reg8::B>(), true);
 		count = 4;
 		break;
 	case 0x99:
-		SUB(GetLoRegister(registers[BC]), true);
+		SUB(Register<Reg8::C>(), true);
 		count = 4;
 		break;
 	case 0x9a:
-		SUB(GetHiRegister(registers[DE]), true);
+		SUB(Register<Reg8::D>(), true);
 		count = 4;
 		break;
 	case 0x9b:
-		SUB(GetLoRegister(registers[DE]), true);
+		SUB(Register<Reg8::E>(), true);
 		count = 4;
 		break;
 	case 0x9c:
-		SUB(GetHiRegister(registers[HL]), true);
+		SUB(Register<Reg8::H>(), true);
 		count = 4;
 		break;
 	case 0x9d:
-		SUB(GetLoRegister(registers[HL]), true);
+		SUB(Register<Reg8::L>(), true);
 		count = 4;
 		break;
 	case 0x9e:
@@ -925,32 +1605,32 @@ uint8_t Z80::Decode(uint8_t opcode)
 		count = 8;
 		break;
 	case 0x9f:
-		SUB(GetHiRegister(registers[AF]), true);
+		SUB(Register<Reg8::A>(), true);
 		count = 4;
 		break;
 	// Ax
 	case 0xa0:
-		AND(GetHiRegister(registers[BC]));
+		AND(Register<Reg8::B>());
 		count = 4;
 		break;
 	case 0xa1:
-		AND(GetLoRegister(registers[BC]));
+		AND(Register<Reg8::C>());
 		count = 4;
 		break;
 	case 0xa2:
-		AND(GetHiRegister(registers[DE]));
+		AND(Register<Reg8::D>());
 		count = 4;
 		break;
 	case 0xa3:
-		AND(GetLoRegister(registers[DE]));
+		AND(Register<Reg8::E>());
 		count = 4;
 		break;
 	case 0xa4:
-		AND(GetHiRegister(registers[HL]));
+		AND(Register<Reg8::H>());
 		count = 4;
 		break;
 	case 0xa5:
-		AND(GetLoRegister(registers[HL]));
+		AND(Register<Reg8::L>());
 		count = 4;
 		break;
 	case 0xa6:
@@ -959,31 +1639,31 @@ uint8_t Z80::Decode(uint8_t opcode)
 		count = 8;
 		break;
 	case 0xa7:
-		AND(GetHiRegister(registers[AF]));
+		AND(Register<Reg8::A>());
 		count = 4;
 		break;
 	case 0xa8:
-		XOR(GetHiRegister(registers[BC]));
+		XOR(Register<Reg8::B>());
 		count = 4;
 		break;
 	case 0xa9:
-		XOR(GetLoRegister(registers[BC]));
+		XOR(Register<Reg8::C>());
 		count = 4;
 		break;
 	case 0xaa:
-		XOR(GetHiRegister(registers[DE]));
+		XOR(Register<Reg8::D>());
 		count = 4;
 		break;
 	case 0xab:
-		XOR(GetLoRegister(registers[DE]));
+		XOR(Register<Reg8::E>());
 		count = 4;
 		break;
 	case 0xac:
-		XOR(GetHiRegister(registers[HL]));
+		XOR(Register<Reg8::H>());
 		count = 4;
 		break;
 	case 0xad:
-		XOR(GetLoRegister(registers[HL]));
+		XOR(Register<Reg8::L>());
 		count = 4;
 		break;
 	case 0xae:
@@ -992,32 +1672,32 @@ uint8_t Z80::Decode(uint8_t opcode)
 		count = 8;
 		break;
 	case 0xaf:
-		XOR(GetHiRegister(registers[AF]));
+		XOR(Register<Reg8::A>());
 		count = 4;
 		break;
 	// Bx
 	case 0xb0:
-		OR(GetHiRegister(registers[BC]));
+		OR(Register<Reg8::B>());
 		count = 4;
 		break;
 	case 0xb1:
-		OR(GetLoRegister(registers[BC]));
+		OR(Register<Reg8::C>());
 		count = 4;
 		break;
 	case 0xb2:
-		OR(GetHiRegister(registers[DE]));
+		OR(Register<Reg8::D>());
 		count = 4;
 		break;
 	case 0xb3:
-		OR(GetLoRegister(registers[DE]));
+		OR(Register<Reg8::E>());
 		count = 4;
 		break;
 	case 0xb4:
-		OR(GetHiRegister(registers[HL]));
+		OR(Register<Reg8::H>());
 		count = 4;
 		break;
 	case 0xb5:
-		OR(GetLoRegister(registers[HL]));
+		OR(Register<Reg8::L>());
 		count = 4;
 		break;
 	case 0xb6:
@@ -1026,31 +1706,31 @@ uint8_t Z80::Decode(uint8_t opcode)
 		count = 8;
 		break;
 	case 0xb7:
-		OR(GetHiRegister(registers[AF]));
+		OR(Register<Reg8::A>());
 		count = 4;
 		break;
 	case 0xb8:
-		CP(GetHiRegister(registers[BC]));
+		CP(Register<Reg8::B>());
 		count = 4;
 		break;
 	case 0xb9:
-		CP(GetLoRegister(registers[BC]));
+		CP(Register<Reg8::C>());
 		count = 4;
 		break;
 	case 0xba:
-		CP(GetHiRegister(registers[DE]));
+		CP(Register<Reg8::D>());
 		count = 4;
 		break;
 	case 0xbb:
-		CP(GetLoRegister(registers[DE]));
+		CP(Register<Reg8::E>());
 		count = 4;
 		break;
 	case 0xbc:
-		CP(GetHiRegister(registers[HL]));
+		CP(Register<Reg8::H>());
 		count = 4;
 		break;
 	case 0xbd:
-		CP(GetLoRegister(registers[HL]));
+		CP(Register<Reg8::L>());
 		count = 4;
 		break;
 	case 0xbe:
@@ -1059,7 +1739,7 @@ uint8_t Z80::Decode(uint8_t opcode)
 		count = 8;
 		break;
 	case 0xbf:
-		CP(GetHiRegister(registers[AF]));
+		CP(Register<Reg8::A>());
 		count = 4;
 		break;
 	// Cx
@@ -1073,22 +1753,19 @@ uint8_t Z80::Decode(uint8_t opcode)
 		break;
 	case 0xc2:
 		nn = Fetch();
-		nn <<= 8;
-		nn |= Fetch();
+		nn |= Fetch() << 8;
 		count = JP(RelFlag::NZ, nn);
 		count += 12;
 		break;
 	case 0xc3:
 		nn = Fetch();
-		nn <<= 8;
-		nn |= Fetch();
+		nn |= Fetch() << 8;
 		JP(nn);
 		count = 16;
 		break;
 	case 0xc4:
 		nn = Fetch();
-		nn <<= 8;
-		nn |= Fetch();
+		nn |= Fetch() << 8;
 		count = CALL(RelFlag::NZ, nn);
 		count += 12;
 		break;
@@ -1115,26 +1792,23 @@ uint8_t Z80::Decode(uint8_t opcode)
 		break;
 	case 0xca:
 		nn = Fetch();
-		nn <<= 8;
-		nn |= Fetch();
+		nn |= Fetch() << 8;
 		count = JP(RelFlag::Z, nn);
 		count += 12;
 		break;
 	case 0xcb:
 		n = Fetch();
-		count = PrefixCB(n);
+		count = DispatchCB(n);
 		break;
 	case 0xcc:
 		nn = Fetch();
-		nn <<= 8;
-		nn |= Fetch();
+		nn |= Fetch() << 8;
 		count = CALL(RelFlag::Z, nn);
 		count += 12;
 		break;
 	case 0xcd:
 		nn = Fetch();
-		nn <<= 8;
-		nn |= Fetch();
+		nn |= Fetch() << 8;
 		CALL(nn);
 		count = 24;
 		break;
@@ -1158,14 +1832,13 @@ uint8_t Z80::Decode(uint8_t opcode)
 		break;
 	case 0xd2:
 		nn = Fetch();
-		nn <<= 8;
-		nn |= Fetch();
+		nn |= Fetch() << 8;
 		count = JP(RelFlag::NC, nn);
 		count += 12;
+		break;
 	case 0xd4:
 		nn = Fetch();
-		nn <<= 8;
-		nn |= Fetch();
+		nn |= Fetch() << 8;
 		count = CALL(RelFlag::NC, nn);
 		count += 12;
 		break;
@@ -1192,15 +1865,13 @@ uint8_t Z80::Decode(uint8_t opcode)
 		break;
 	case 0xda:
 		nn = Fetch();
-		nn <<= 8;
-		nn |= Fetch();
+		nn |= Fetch() << 8;
 		count = JP(RelFlag::C, nn);
 		count += 12;
 		break;
 	case 0xdc:
 		nn = Fetch();
-		nn <<= 8;
-		nn |= Fetch();
+		nn |= Fetch() << 8;
 		count = CALL(RelFlag::C, nn);
 		count += 12;
 		break;
@@ -1216,7 +1887,7 @@ uint8_t Z80::Decode(uint8_t opcode)
 	// Ex
 	case 0xe0:
 		n = Fetch();
-		LD8(0xff00 + n, GetHiRegister(registers[AF]));
+		LD8(0xff00 + n, Register<Reg8::A>());
 		count = 12;
 		break;
 	case 0xe1:
@@ -1224,7 +1895,7 @@ uint8_t Z80::Decode(uint8_t opcode)
 		count = 12;
 		break;
 	case 0xe2:
-		LD8(0xff00 + GetLoRegister(registers[BC]), GetHiRegister(registers[AF]));
+		LD8(0xff00 + Register<Reg8::C>(), Register<Reg8::A>());
 		count = 8;
 		break;
 	case 0xe5:
@@ -1251,9 +1922,8 @@ uint8_t Z80::Decode(uint8_t opcode)
 		break;
 	case 0xea:
 		nn = Fetch();
-		nn <<= 8;
-		nn |= Fetch();
-		LD16(nn, GetHiRegister(registers[AF]));
+		nn |= Fetch() << 8;
+		LD8(nn, Register<Reg8::A>());
 		count = 16;
 		break;
 	case 0xee:
@@ -1268,15 +1938,18 @@ uint8_t Z80::Decode(uint8_t opcode)
 	// Fx
 	case 0xf0:
 		n = Fetch();
-		LD8(registers[AF], "hi", 0xff00 + n);
+		LD8<Reg8::A>(ReadMem(0xff00 + n));
 		count = 12;
 		break;
 	case 0xf1:
 		POP(registers[AF]);
+		// The low nibble of F always reads 0.
+		registers[AF] &= 0xfff0;
+		DiscardFlags();
 		count = 12;
 		break;
 	case 0xf2:
-		LD8(registers[AF], "hi", ReadMem(0xff00 + GetLoRegister(registers[BC])));
+		LD8<Reg8::A>(ReadMem(0xff00 + Register<Reg8::C>()));
 		count = 8;
 		break;
 	case 0xf3:
@@ -1284,6 +1957,7 @@ uint8_t Z80::Decode(uint8_t opcode)
 		count = 4;
 		break;
 	case 0xf5:
+		FlushFlags();
 		PUSH(registers[AF]);
 		count = 16;
 		break;
@@ -1297,8 +1971,12 @@ uint8_t Z80::Decode(uint8_t opcode)
 		count = 16;
 		break;
 	case 0xf8:
+		// Same flags as ADD SP,d.
 		n = Fetch();
-		LD16(registers[HL], sp + (int8_t) n);
+		nn = sp;
+		ADD16((int8_t) n);
+		LD16(registers[HL], sp);
+		LD16(sp, nn);
 		count = 12;
 		break;
 	case 0xf9:
@@ -1307,9 +1985,8 @@ uint8_t Z80::Decode(uint8_t opcode)
 		break;
 	case 0xfa:
 		nn = Fetch();
-		nn <<= 8;
-		nn |= Fetch();
-		LD8(registers[AF], "hi", ReadMem(nn));
+		nn |= Fetch() << 8;
+		LD8<Reg8::A>(ReadMem(nn));
 		count = 16;
 		break;
 	case 0xfb:
@@ -1329,34 +2006,34 @@ uint8_t Z80::Decode(uint8_t opcode)
 	return count;
 }
 
-uint8_t Z80::PrefixCB(uint8_t opcode)
+Z80_FORCEINLINE uint8_t Z80::PrefixCB(uint8_t opcode)
 {
 	uint8_t count = 0;
 	switch(opcode)
 	{
 	// 0x
 	case 0x0:
-		RLC(registers[BC], "hi");
+		RLC<Reg8::B>();
 		count = 8;
 		break;
 	case 0x1:
-		RLC(registers[BC], "lo");
+		RLC<Reg8::C>();
 		count = 8;
 		break;
 	case 0x2:
-		RLC(registers[DE], "hi");
+		RLC<Reg8::D>();
 		count = 8;
 		break;
 	case 0x3:
-		RLC(registers[DE], "lo");
+		RLC<Reg8::E>();
 		count = 8;
 		break;
 	case 0x4:
-		RLC(registers[HL], "hi");
+		RLC<Reg8::H>();
 		count = 8;
 		break;
 	case 0x5:
-		RLC(registers[HL], "lo");
+		RLC<Reg8::L>();
 		count = 8;
 		break;
 	case 0x6:
@@ -1364,96 +2041,96 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0x7:
-		RLC(registers[AF], "hi");
+		RLC<Reg8::A>();
 		count = 8;
 		break;
 	case 0x8:
-		RRC(registers[BC], "hi");
+		RRC<Reg8::B>();
 		count = 8;
 		break;
 	case 0x9:
-		RRC(registers[BC], "lo");
+		RRC<Reg8::C>();
 		count = 8;
 		break;
 	case 0xa:
-		RRC(registers[DE], "hi");
+		RRC<Reg8::D>();
 		count = 8;
 		break;
 	case 0xb:
-		RRC(registers[DE], "lo");
+		RRC<Reg8::E>();
 		count = 8;
 		break;
 	case 0xc:
-		RRC(registers[HL], "hi");
+		RRC<Reg8::H>();
 		count = 8;
 		break;
 	case 0xd:
-		RRC(registers[HL], "lo");
+		RRC<Reg8::L>();
 		count = 8;
 		break;
 	case 0xe:
-		RLC();
+		RRC();
 		count = 16;
 		break;
 	case 0xf:
-		RRC(registers[AF], "hi");
+		RRC<Reg8::A>();
 		count = 8;
 		break;
 	// 1x
 	case 0x10:
-		RR(registers[BC], "hi");
+		RL<Reg8::B>();
 		count = 8;
 		break;
 	case 0x11:
-		RR(registers[BC], "lo");
+		RL<Reg8::C>();
 		count = 8;
 		break;
 	case 0x12:
-		RR(registers[DE], "hi");
+		RL<Reg8::D>();
 		count = 8;
 		break;
 	case 0x13:
-		RR(registers[DE], "lo");
+		RL<Reg8::E>();
 		count = 8;
 		break;
 	case 0x14:
-		RR(registers[HL], "hi");
+		RL<Reg8::H>();
 		count = 8;
 		break;
 	case 0x15:
-		RR(registers[HL], "lo");
+		RL<Reg8::L>();
 		count = 8;
 		break;
 	case 0x16:
-		RR();
+		RL();
 		count = 16;
 		break;
 	case 0x17:
-		RR(registers[AF], "hi");
+		RL<Reg8::A>();
 		count = 8;
 		break;
 	case 0x18:
-		RR(registers[BC], "hi");
+		RR<Reg8::B>();
 		count = 8;
 		break;
 	case 0x19:
-		RR(registers[BC], "lo");
+		RR<Reg8::C>();
 		count = 8;
 		break;
 	case 0x1a:
-		RR(registers[DE], "hi");
+		RR<Reg8::D>();
 		count = 8;
 		break;
 	case 0x1b:
-		RR(registers[DE], "lo");
+		RR<Reg8::E>();
 		count = 8;
 		break;
 	case 0x1c:
-		RR(registers[HL], "hi");
+		RR<Reg8::H>();
 		count = 8;
 		break;
 	case 0x1d:
-		RR(registers[HL], "lo");
+		RR<Reg8::L>();
 		count = 8;
 		break;
 	case 0x1e:
@@ -1461,32 +2138,32 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0x1f:
-		RR(registers[AF], "hi");
+		RR<Reg8::A>();
 		count = 8;
 		break;
 	// 2x
 	case 0x20:
-		SLA(registers[BC], "hi");
+		SLA<Reg8::B>();
 		count = 8;
 		break;
 	case 0x21:
-		SLA(registers[BC], "lo");
+		SLA<Reg8::C>();
 		count = 8;
 		break;
 	case 0x22:
-		SLA(registers[DE], "hi");
+		SLA<Reg8::D>();
 		count = 8;
 		break;
 	case 0x23:
-		SLA(registers[DE], "lo");
+		SLA<Reg8::E>();
 		count = 8;
 		break;
 	case 0x24:
-		SLA(registers[HL], "hi");
+		SLA<Reg8::H>();
 		count = 8;
 		break;
 	case 0x25:
-		SLA(registers[HL], "lo");
+		SLA<Reg8::L>();
 		count = 8;
 		break;
 	case 0x26:
@@ -1494,31 +2171,31 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0x27:
-		SLA(registers[AF], "hi");
+		SLA<Reg8::A>();
 		count = 8;
 		break;
 	case 0x28:
-		SRA(registers[BC], "hi");
+		SRA<Reg8::B>();
 		count = 8;
 		break;
 	case 0x29:
-		SRA(registers[BC], "lo");
+		SRA<Reg8::C>();
 		count = 8;
 		break;
 	case 0x2a:
-		SRA(registers[DE], "hi");
+		SRA<Reg8::D>();
 		count = 8;
 		break;
 	case 0x2b:
-		SRA(registers[DE], "lo");
+		SRA<Reg8::E>();
 		count = 8;
 		break;
 	case 0x2c:
-		SRA(registers[HL], "hi");
+		SRA<Reg8::H>();
 		count = 8;
 		break;
 	case 0x2d:
-		SRA(registers[HL], "lo");
+		SRA<Reg8::L>();
 		count = 8;
 		break;
 	case 0x2e:
@@ -1526,32 +2203,32 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0x2f:
-		SRA(registers[AF], "hi");
+		SRA<Reg8::A>();
 		count = 8;
 		break;
 	// 3x
 	case 0x30:
-		SWAP(registers[BC], "hi");
+		SWAP<Reg8::B>();
 		count = 8;
 		break;
 	case 0x31:
-		SWAP(registers[BC], "lo");
+		SWAP<Reg8::C>();
 		count = 8;
 		break;
 	case 0x32:
-		SWAP(registers[DE], "hi");
+		SWAP<Reg8::D>();
 		count = 8;
 		break;
 	case 0x33:
-		SWAP(registers[DE], "lo");
+		SWAP<Reg8::E>();
 		count = 8;
 		break;
 	case 0x34:
-		SWAP(registers[HL], "hi");
+		SWAP<Reg8::H>();
 		count = 8;
 		break;
 	case 0x35:
-		SWAP(registers[HL], "lo");
+		SWAP<Reg8::L>();
 		count = 8;
 		break;
 	case 0x36:
@@ -1559,31 +2236,31 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0x37:
-		SWAP(registers[AF], "hi");
+		SWAP<Reg8::A>();
 		count = 8;
 		break;
 	case 0x38:
-		SRL(registers[BC], "hi");
+		SRL<Reg8::B>();
 		count = 8;
 		break;
 	case 0x39:
-		SRL(registers[BC], "lo");
+		SRL<Reg8::C>();
 		count = 8;
 		break;
 	case 0x3a:
-		SRL(registers[DE], "hi");
+		SRL<Reg8::D>();
 		count = 8;
 		break;
 	case 0x3b:
-		SRL(registers[DE], "lo");
+		SRL<Reg8::E>();
 		count = 8;
 		break;
 	case 0x3c:
-		SRL(registers[HL], "hi");
+		SRL<Reg8::H>();
 		count = 8;
 		break;
 	case 0x3d:
-		SRL(registers[HL], "lo");
+		SRL<Reg8::L>();
 		count = 8;
 		break;
 	case 0x3e:
@@ -1591,32 +2268,32 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0x3f:
-		SRL(registers[AF], "hi");
+		SRL<Reg8::A>();
 		count = 8;
 		break;
 	// 4x
 	case 0x40:
-		BIT(registers[BC], "hi", 0);
+		BIT<Reg8::B>(0);
 		count = 8;
 		break;
 	case 0x41:
-		BIT(registers[BC], "lo", 0);
+		BIT<Reg8::C>(0);
 		count = 8;
 		break;
 	case 0x42:
-		BIT(registers[DE], "hi", 0);
+		BIT<Reg8::D>(0);
 		count = 8;
 		break;
 	case 0x43:
-		BIT(registers[DE], "lo", 0);
+		BIT<Reg8::E>(0);
 		count = 8;
 		break;
 	case 0x44:
-		BIT(registers[HL], "hi", 0);
+		BIT<Reg8::H>(0);
 		count = 8;
 		break;
 	case 0x45:
-		BIT(registers[HL], "lo", 0);
+		BIT<Reg8::L>(0);
 		count = 8;
 		break;
 	case 0x46:
@@ -1624,31 +2301,31 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0x47:
-		BIT(registers[AF], "hi", 0);
+		BIT<Reg8::A>(0);
 		count = 8;
 		break;
 	case 0x48:
-		BIT(registers[BC], "hi", 1);
+		BIT<Reg8::B>(1);
 		count = 8;
 		break;
 	case 0x49:
-		BIT(registers[BC], "lo", 1);
+		BIT<Reg8::C>(1);
 		count = 8;
 		break;
 	case 0x4a:
-		BIT(registers[DE], "hi", 1);
+		BIT<Reg8::D>(1);
 		count = 8;
 		break;
 	case 0x4b:
-		BIT(registers[DE], "lo", 1);
+		BIT<Reg8::E>(1);
 		count = 8;
 		break;
 	case 0x4c:
-		BIT(registers[HL], "hi", 1);
+		BIT<Reg8::H>(1);
 		count = 8;
 		break;
 	case 0x4d:
-		BIT(registers[HL], "lo", 1);
+		BIT<Reg8::L>(1);
 		count = 8;
 		break;
 	case 0x4e:
@@ -1656,32 +2333,32 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0x4f:
-		BIT(registers[AF], "hi", 1);
+		BIT<Reg8::A>(1);
 		count = 8;
 		break;
 	// 5x
 	case 0x50:
-		BIT(registers[BC], "hi", 2);
+		BIT<Reg8::B>(2);
 		count = 8;
 		break;
 	case 0x51:
-		BIT(registers[BC], "lo", 2);
+		BIT<Reg8::C>(2);
 		count = 8;
 		break;
 	case 0x52:
-		BIT(registers[DE], "hi", 2);
+		BIT<Reg8::D>(2);
 		count = 8;
 		break;
 	case 0x53:
-		BIT(registers[DE], "lo", 2);
+		BIT<Reg8::E>(2);
 		count = 8;
 		break;
 	case 0x54:
-		BIT(registers[HL], "hi", 2);
+		BIT<Reg8::H>(2);
 		count = 8;
 		break;
 	case 0x55:
-		BIT(registers[HL], "lo", 2);
+		BIT<Reg8::L>(2);
 		count = 8;
 		break;
 	case 0x56:
@@ -1689,31 +2366,31 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0x57:
-		BIT(registers[AF], "hi", 2);
+		BIT<Reg8::A>(2);
 		count = 8;
 		break;
 	case 0x58:
-		BIT(registers[BC], "hi", 3);
+		BIT<Reg8::B>(3);
 		count = 8;
 		break;
 	case 0x59:
-		BIT(registers[BC], "lo", 3);
+		BIT<Reg8::C>(3);
 		count = 8;
 		break;
 	case 0x5a:
-		BIT(registers[DE], "hi", 3);
+		BIT<Reg8::D>(3);
 		count = 8;
 		break;
 	case 0x5b:
-		BIT(registers[DE], "lo", 3);
+		BIT<Reg8::E>(3);
 		count = 8;
 		break;
 	case 0x5c:
-		BIT(registers[HL], "hi", 3);
+		BIT<Reg8::H>(3);
 		count = 8;
 		break;
 	case 0x5d:
-		BIT(registers[HL], "lo", 3);
+		BIT<Reg8::L>(3);
 		count = 8;
 		break;
 	case 0x5e:
@@ -1721,32 +2398,32 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0x5f:
-		BIT(registers[AF], "hi", 3);
+		BIT<Reg8::A>(3);
 		count = 8;
 		break;
 	// 6x
 	case 0x60:
-		BIT(registers[BC], "hi", 4);
+		BIT<Reg8::B>(4);
 		count = 8;
 		break;
 	case 0x61:
-		BIT(registers[BC], "lo", 4);
+		BIT<Reg8::C>(4);
 		count = 8;
 		break;
 	case 0x62:
-		BIT(registers[DE], "hi", 4);
+		BIT<Reg8::D>(4);
 		count = 8;
 		break;
 	case 0x63:
-		BIT(registers[DE], "lo", 4);
+		BIT<Reg8::E>(4);
 		count = 8;
 		break;
 	case 0x64:
-		BIT(registers[HL], "hi", 4);
+		BIT<Reg8::H>(4);
 		count = 8;
 		break;
 	case 0x65:
-		BIT(registers[HL], "lo", 4);
+		BIT<Reg8::L>(4);
 		count = 8;
 		break;
 	case 0x66:
@@ -1754,31 +2431,31 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0x67:
-		BIT(registers[AF], "hi", 4);
+		BIT<Reg8::A>(4);
 		count = 8;
 		break;
 	case 0x68:
-		BIT(registers[BC], "hi", 5);
+		BIT<Reg8::B>(5);
 		count = 8;
 		break;
 	case 0x69:
-		BIT(registers[BC], "lo", 5);
+		BIT<Reg8::C>(5);
 		count = 8;
 		break;
 	case 0x6a:
-		BIT(registers[DE], "hi", 5);
+		BIT<Reg8::D>(5);
 		count = 8;
 		break;
 	case 0x6b:
-		BIT(registers[DE], "lo", 5);
+		BIT<Reg8::E>(5);
 		count = 8;
 		break;
 	case 0x6c:
-		BIT(registers[HL], "hi", 5);
+		BIT<Reg8::H>(5);
 		count = 8;
 		break;
 	case 0x6d:
-		BIT(registers[HL], "lo", 5);
+		BIT<Reg8::L>(5);
 		count = 8;
 		break;
 	case 0x6e:
@@ -1786,32 +2463,32 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0x6f:
-		BIT(registers[AF], "hi", 5);
+		BIT<Reg8::A>(5);
 		count = 8;
 		break;
 	// 7x
 	case 0x70:
-		BIT(registers[BC], "hi", 6);
+		BIT<Reg8::B>(6);
 		count = 8;
 		break;
 	case 0x71:
-		BIT(registers[BC], "lo", 6);
+		BIT<Reg8::C>(6);
 		count = 8;
 		break;
 	case 0x72:
-		BIT(registers[DE], "hi", 6);
+		BIT<Reg8::D>(6);
 		count = 8;
 		break;
 	case 0x73:
-		BIT(registers[DE], "lo", 6);
+		BIT<Reg8::E>(6);
 		count = 8;
 		break;
 	case 0x74:
-		BIT(registers[HL], "hi", 6);
+		BIT<Reg8::H>(6);
 		count = 8;
 		break;
 	case 0x75:
-		BIT(registers[HL], "lo", 6);
+		BIT<Reg8::L>(6);
 		count = 8;
 		break;
 	case 0x76:
@@ -1819,31 +2496,31 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0x77:
-		BIT(registers[AF], "hi", 6);
+		BIT<Reg8::A>(6);
 		count = 8;
 		break;
 	case 0x78:
-		BIT(registers[BC], "hi", 7);
+		BIT<Reg8::B>(7);
 		count = 8;
 		break;
 	case 0x79:
-		BIT(registers[BC], "lo", 7);
+		BIT<Reg8::C>(7);
 		count = 8;
 		break;
 	case 0x7a:
-		BIT(registers[DE], "hi", 7);
+		BIT<Reg8::D>(7);
 		count = 8;
 		break;
 	case 0x7b:
-		BIT(registers[DE], "lo", 7);
+		BIT<Reg8::E>(7);
 		count = 8;
 		break;
 	case 0x7c:
-		BIT(registers[HL], "hi", 7);
+		BIT<Reg8::H>(7);
 		count = 8;
 		break;
 	case 0x7d:
-		BIT(registers[HL], "lo", 7);
+		BIT<Reg8::L>(7);
 		count = 8;
 		break;
 	case 0x7e:
@@ -1851,32 +2528,32 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0x7f:
-		BIT(registers[AF], "hi", 7);
+		BIT<Reg8::A>(7);
 		count = 8;
 		break;
 	// 8x
 	case 0x80:
-		RES(registers[BC], "hi", 0);
+		RES<Reg8::B>(0);
 		count = 8;
 		break;
 	case 0x81:
-		RES(registers[BC], "lo", 0);
+		RES<Reg8::C>(0);
 		count = 8;
 		break;
 	case 0x82:
-		RES(registers[DE], "hi", 0);
+		RES<Reg8::D>(0);
 		count = 8;
 		break;
 	case 0x83:
-		RES(registers[DE], "lo", 0);
+		RES<Reg8::E>(0);
 		count = 8;
 		break;
 	case 0x84:
-		RES(registers[HL], "hi", 0);
+		RES<Reg8::H>(0);
 		count = 8;
 		break;
 	case 0x85:
-		RES(registers[HL], "lo", 0);
+		RES<Reg8::L>(0);
 		count = 8;
 		break;
 	case 0x86:
@@ -1884,31 +2561,31 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0x87:
-		RES(registers[AF], "hi", 0);
+		RES<Reg8::A>(0);
 		count = 8;
 		break;
 	case 0x88:
-		RES(registers[BC], "hi", 1);
+		RES<Reg8::B>(1);
 		count = 8;
 		break;
 	case 0x89:
-		RES(registers[BC], "lo", 1);
+		RES<Reg8::C>(1);
 		count = 8;
 		break;
 	case 0x8a:
-		RES(registers[DE], "hi", 1);
+		RES<Reg8::D>(1);
 		count = 8;
 		break;
 	case 0x8b:
-		RES(registers[DE], "lo", 1);
+		RES<Reg8::E>(1);
 		count = 8;
 		break;
 	case 0x8c:
-		RES(registers[HL], "hi", 1);
+		RES<Reg8::H>(1);
 		count = 8;
 		break;
 	case 0x8d:
-		RES(registers[HL], "lo", 1);
+		RES<Reg8::L>(1);
 		count = 8;
 		break;
 	case 0x8e:
@@ -1916,32 +2593,32 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0x8f:
-		RES(registers[AF], "hi", 1);
+		RES<Reg8::A>(1);
 		count = 8;
 		break;
 	// 9x
 	case 0x90:
-		RES(registers[BC], "hi", 2);
+		RES<Reg8::B>(2);
 		count = 8;
 		break;
 	case 0x91:
-		RES(registers[BC], "lo", 2);
+		RES<Reg8::C>(2);
 		count = 8;
 		break;
 	case 0x92:
-		RES(registers[DE], "hi", 2);
+		RES<Reg8::D>(2);
 		count = 8;
 		break;
 	case 0x93:
-		RES(registers[DE], "lo", 2);
+		RES<Reg8::E>(2);
 		count = 8;
 		break;
 	case 0x94:
-		RES(registers[HL], "hi", 2);
+		RES<Reg8::H>(2);
 		count = 8;
 		break;
 	case 0x95:
-		RES(registers[HL], "lo", 2);
+		RES<Reg8::L>(2);
 		count = 8;
 		break;
 	case 0x96:
@@ -1949,31 +2626,31 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0x97:
-		RES(registers[AF], "hi", 2);
+		RES<Reg8::A>(2);
 		count = 8;
 		break;
 	case 0x98:
-		RES(registers[BC], "hi", 3);
+		RES<Reg8::B>(3);
 		count = 8;
 		break;
 	case 0x99:
-		RES(registers[BC], "lo", 3);
+		RES<Reg8::C>(3);
 		count = 8;
 		break;
 	case 0x9a:
-		RES(registers[DE], "hi", 3);
+		RES<Reg8::D>(3);
 		count = 8;
 		break;
 	case 0x9b:
-		RES(registers[DE], "lo", 3);
+		RES<Reg8::E>(3);
 		count = 8;
 		break;
 	case 0x9c:
-		RES(registers[HL], "hi", 3);
+		RES<Reg8::H>(3);
 		count = 8;
 		break;
 	case 0x9d:
-		RES(registers[HL], "lo", 3);
+		RES<Reg8::L>(3);
 		count = 8;
 		break;
 	case 0x9e:
@@ -1981,32 +2658,32 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0x9f:
-		RES(registers[AF], "hi", 3);
+		RES<Reg8::A>(3);
 		count = 8;
 		break;
 	// Ax
 	case 0xa0:
-		RES(registers[BC], "hi", 4);
+		RES<Reg8::B>(4);
 		count = 8;
 		break;
 	case 0xa1:
-		RES(registers[BC], "lo", 4);
+		RES<Reg8::C>(4);
 		count = 8;
 		break;
 	case 0xa2:
-		RES(registers[DE], "hi", 4);
+		RES<Reg8::D>(4);
 		count = 8;
 		break;
 	case 0xa3:
-		RES(registers[DE], "lo", 4);
+		RES<Reg8::E>(4);
 		count = 8;
 		break;
 	case 0xa4:
-		RES(registers[HL], "hi", 4);
+		RES<Reg8::H>(4);
 		count = 8;
 		break;
 	case 0xa5:
-		RES(registers[HL], "lo", 4);
+		RES<Reg8::L>(4);
 		count = 8;
 		break;
 	case 0xa6:
@@ -2014,31 +2691,31 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0xa7:
-		RES(registers[AF], "hi", 4);
+		RES<Reg8::A>(4);
 		count = 8;
 		break;
 	case 0xa8:
-		RES(registers[BC], "hi", 5);
+		RES<Reg8::B>(5);
 		count = 8;
 		break;
 	case 0xa9:
-		RES(registers[BC], "lo", 5);
+		RES<Reg8::C>(5);
 		count = 8;
 		break;
 	case 0xaa:
-		RES(registers[DE], "hi", 5);
+		RES<Reg8::D>(5);
 		count = 8;
 		break;
 	case 0xab:
-		RES(registers[DE], "lo", 5);
+		RES<Reg8::E>(5);
 		count = 8;
 		break;
 	case 0xac:
-		RES(registers[HL], "hi", 5);
+		RES<Reg8::H>(5);
 		count = 8;
 		break;
 	case 0xad:
-		RES(registers[HL], "lo", 5);
+		RES<Reg8::L>(5);
 		count = 8;
 		break;
 	case 0xae:
@@ -2046,32 +2723,32 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0xaf:
-		RES(registers[AF], "hi", 5);
+		RES<Reg8::A>(5);
 		count = 8;
 		break;
 	// Bx
 	case 0xb0:
-		RES(registers[BC], "hi", 6);
+		RES<Reg8::B>(6);
 		count = 8;
 		break;
 	case 0xb1:
-		RES(registers[BC], "lo", 6);
+		RES<Reg8::C>(6);
 		count = 8;
 		break;
 	case 0xb2:
-		RES(registers[DE], "hi", 6);
+		RES<Reg8::D>(6);
 		count = 8;
 		break;
 	case 0xb3:
-		RES(registers[DE], "lo", 6);
+		RES<Reg8::E>(6);
 		count = 8;
 		break;
 	case 0xb4:
-		RES(registers[HL], "hi", 6);
+		RES<Reg8::H>(6);
 		count = 8;
 		break;
 	case 0xb5:
-		RES(registers[HL], "lo", 6);
+		RES<Reg8::L>(6);
 		count = 8;
 		break;
 	case 0xb6:
@@ -2079,31 +2756,31 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0xb7:
-		RES(registers[AF], "hi", 6);
+		RES<Reg8::A>(6);
 		count = 8;
 		break;
 	case 0xb8:
-		RES(registers[BC], "hi", 7);
+		RES<Reg8::B>(7);
 		count = 8;
 		break;
 	case 0xb9:
-		RES(registers[BC], "lo", 7);
+		RES<Reg8::C>(7);
 		count = 8;
 		break;
 	case 0xba:
-		RES(registers[DE], "hi", 7);
+		RES<Reg8::D>(7);
 		count = 8;
 		break;
 	case 0xbb:
-		RES(registers[DE], "lo", 7);
+		RES<Reg8::E>(7);
 		count = 8;
 		break;
 	case 0xbc:
-		RES(registers[HL], "hi", 7);
+		RES<Reg8::H>(7);
 		count = 8;
 		break;
 	case 0xbd:
-		RES(registers[HL], "lo", 7);
+		RES<Reg8::L>(7);
 		count = 8;
 		break;
 	case 0xbe:
@@ -2111,32 +2788,32 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0xbf:
-		RES(registers[AF], "hi", 7);
+		RES<Reg8::A>(7);
 		count = 8;
 		break;
 	// Cx
 	case 0xc0:
-		SET(registers[BC], "hi", 0);
+		SET<Reg8::B>(0);
 		count = 8;
 		break;
 	case 0xc1:
-		SET(registers[BC], "lo", 0);
+		SET<Reg8::C>(0);
 		count = 8;
 		break;
 	case 0xc2:
-		SET(registers[DE], "hi", 0);
+		SET<Reg8::D>(0);
 		count = 8;
 		break;
 	case 0xc3:
-		SET(registers[DE], "lo", 0);
+		SET<Reg8::E>(0);
 		count = 8;
 		break;
 	case 0xc4:
-		SET(registers[HL], "hi", 0);
+		SET<Reg8::H>(0);
 		count = 8;
 		break;
 	case 0xc5:
-		SET(registers[HL], "lo", 0);
+		SET<Reg8::L>(0);
 		count = 8;
 		break;
 	case 0xc6:
@@ -2144,31 +2821,31 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0xc7:
-		SET(registers[AF], "hi", 0);
+		SET<Reg8::A>(0);
 		count = 8;
 		break;
 	case 0xc8:
-		SET(registers[BC], "hi", 1);
+		SET<Reg8::B>(1);
 		count = 8;
 		break;
 	case 0xc9:
-		SET(registers[BC], "lo", 1);
+		SET<Reg8::C>(1);
 		count = 8;
 		break;
 	case 0xca:
-		SET(registers[DE], "hi", 1);
+		SET<Reg8::D>(1);
 		count = 8;
 		break;
 	case 0xcb:
-		SET(registers[DE], "lo", 1);
+		SET<Reg8::E>(1);
 		count = 8;
 		break;
 	case 0xcc:
-		SET(registers[HL], "hi", 1);
+		SET<Reg8::H>(1);
 		count = 8;
 		break;
 	case 0xcd:
-		SET(registers[HL], "lo", 1);
+		SET<Reg8::L>(1);
 		count = 8;
 		break;
 	case 0xce:
@@ -2176,32 +2853,32 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0xcf:
-		SET(registers[AF], "hi", 1);
+		SET<Reg8::A>(1);
 		count = 8;
 		break;
 	// Dx
 	case 0xd0:
-		SET(registers[BC], "hi", 2);
+		SET<Reg8::B>(2);
 		count = 8;
 		break;
 	case 0xd1:
-		SET(registers[BC], "lo", 2);
+		SET<Reg8::C>(2);
 		count = 8;
 		break;
 	case 0xd2:
-		SET(registers[DE], "hi", 2);
+		SET<Reg8::D>(2);
 		count = 8;
 		break;
 	case 0xd3:
-		SET(registers[DE], "lo", 2);
+		SET<Reg8::E>(2);
 		count = 8;
 		break;
 	case 0xd4:
-		SET(registers[HL], "hi", 2);
+		SET<Reg8::H>(2);
 		count = 8;
 		break;
 	case 0xd5:
-		SET(registers[HL], "lo", 2);
+		SET<Reg8::L>(2);
 		count = 8;
 		break;
 	case 0xd6:
@@ -2209,31 +2886,31 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0xd7:
-		SET(registers[AF], "hi", 2);
+		SET<Reg8::A>(2);
 		count = 8;
 		break;
 	case 0xd8:
-		SET(registers[BC], "hi", 3);
+		SET<Reg8::B>(3);
 		count = 8;
 		break;
 	case 0xd9:
-		SET(registers[BC], "lo", 3);
+		SET<Reg8::C>(3);
 		count = 8;
 		break;
 	case 0xda:
-		SET(registers[DE], "hi", 3);
+		SET<Reg8::D>(3);
 		count = 8;
 		break;
 	case 0xdb:
-		SET(registers[DE], "lo", 3);
+		SET<Reg8::E>(3);
 		count = 8;
 		break;
 	case 0xdc:
-		SET(registers[HL], "hi", 3);
+		SET<Reg8::H>(3);
 		count = 8;
 		break;
 	case 0xdd:
-		SET(registers[HL], "lo", 3);
+		SET<Reg8::L>(3);
 		count = 8;
 		break;
 	case 0xde:
@@ -2241,32 +2918,32 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0xdf:
-		SET(registers[AF], "hi", 3);
+		SET<Reg8::A>(3);
 		count = 8;
 		break;
 	// Ex
 	case 0xe0:
-		SET(registers[BC], "hi", 4);
+		SET<Reg8::B>(4);
 		count = 8;
 		break;
 	case 0xe1:
-		SET(registers[BC], "lo", 4);
+		SET<Reg8::C>(4);
 		count = 8;
 		break;
 	case 0xe2:
-		SET(registers[DE], "hi", 4);
+		SET<Reg8::D>(4);
 		count = 8;
 		break;
 	case 0xe3:
-		SET(registers[DE], "lo", 4);
+		SET<Reg8::E>(4);
 		count = 8;
 		break;
 	case 0xe4:
-		SET(registers[HL], "hi", 4);
+		SET<Reg8::H>(4);
 		count = 8;
 		break;
 	case 0xe5:
-		SET(registers[HL], "lo", 4);
+		SET<Reg8::L>(4);
 		count = 8;
 		break;
 	case 0xe6:
@@ -2274,31 +2951,31 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0xe7:
-		SET(registers[AF], "hi", 4);
+		SET<Reg8::A>(4);
 		count = 8;
 		break;
 	case 0xe8:
-		SET(registers[BC], "hi", 5);
+		SET<Reg8::B>(5);
 		count = 8;
 		break;
 	case 0xe9:
-		SET(registers[BC], "lo", 5);
+		SET<Reg8::C>(5);
 		count = 8;
 		break;
 	case 0xea:
-		SET(registers[DE], "hi", 5);
+		SET<Reg8::D>(5);
 		count = 8;
 		break;
 	case 0xeb:
-		SET(registers[DE], "lo", 5);
+		SET<Reg8::E>(5);
 		count = 8;
 		break;
 	case 0xec:
-		SET(registers[HL], "hi", 5);
+		SET<Reg8::H>(5);
 		count = 8;
 		break;
 	case 0xed:
-		SET(registers[HL], "lo", 5);
+		SET<Reg8::L>(5);
 		count = 8;
 		break;
 	case 0xee:
@@ -2306,32 +2983,32 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0xef:
-		SET(registers[AF], "hi", 5);
+		SET<Reg8::A>(5);
 		count = 8;
 		break;
 	// Fx
 	case 0xf0:
-		SET(registers[BC], "hi", 6);
+		SET<Reg8::B>(6);
 		count = 8;
 		break;
 	case 0xf1:
-		SET(registers[BC], "lo", 6);
+		SET<Reg8::C>(6);
 		count = 8;
 		break;
 	case 0xf2:
-		SET(registers[DE], "hi", 6);
+		SET<Reg8::D>(6);
 		count = 8;
 		break;
 	case 0xf3:
-		SET(registers[DE], "lo", 6);
+		SET<Reg8::E>(6);
 		count = 8;
 		break;
 	case 0xf4:
-		SET(registers[HL], "hi", 6);
+		SET<Reg8::H>(6);
 		count = 8;
 		break;
 	case 0xf5:
-		SET(registers[HL], "lo", 6);
+		SET<Reg8::L>(6);
 		count = 8;
 		break;
 	case 0xf6:
@@ -2339,31 +3016,31 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0xf7:
-		SET(registers[AF], "hi", 6);
+		SET<Reg8::A>(6);
 		count = 8;
 		break;
 	case 0xf8:
-		SET(registers[BC], "hi", 7);
+		SET<Reg8::B>(7);
 		count = 8;
 		break;
 	case 0xf9:
-		SET(registers[BC], "lo", 7);
+		SET<Reg8::C>(7);
 		count = 8;
 		break;
 	case 0xfa:
-		SET(registers[DE], "hi", 7);
+		SET<Reg8::D>(7);
 		count = 8;
 		break;
 	case 0xfb:
-		SET(registers[DE], "lo", 7);
+		SET<Reg8::E>(7);
 		count = 8;
 		break;
 	case 0xfc:
-		SET(registers[HL], "hi", 7);
+		SET<Reg8::H>(7);
 		count = 8;
 		break;
 	case 0xfd:
-		SET(registers[HL], "lo", 7);
+		SET<Reg8::L>(7);
 		count = 8;
 		break;
 	case 0xfe:
@@ -2371,47 +3048,514 @@ uint8_t Z80::PrefixCB(uint8_t opcode)
 		count = 16;
 		break;
 	case 0xff:
-		SET(registers[AF], "hi", 7);
+		SET<Reg8::A>(7);
 		count = 8;
 		break;
 	}
-	return count;
+	return count;
+}
+
+#define OPCODE_ROW(X, hi) \
+	X(0x##hi##0) X(0x##hi##1) X(0x##hi##2) X(0x##hi##3) \
+	X(0x##hi##4) X(0x##hi##5) X(0x##hi##6) X(0x##hi##7) \
+	X(0x##hi##8) X(0x##hi##9) X(0x##hi##a) X(0x##hi##b) \
+	X(0x##hi##c) X(0x##hi##d) X(0x##hi##e) X(0x##hi##f)
+#define OPCODES(X) \
+	OPCODE_ROW(X, 0) OPCODE_ROW(X, 1) OPCODE_ROW(X, 2) OPCODE_ROW(X, 3) \
+	OPCODE_ROW(X, 4) OPCODE_ROW(X, 5) OPCODE_ROW(X, 6) OPCODE_ROW(X, 7) \
+	OPCODE_ROW(X, 8) OPCODE_ROW(X, 9) OPCODE_ROW(X, a) OPCODE_ROW(X, b) \
+	OPCODE_ROW(X, c) OPCODE_ROW(X, d) OPCODE_ROW(X, e) OPCODE_ROW(X, f)
+
+template<uint8_t opcode>
+uint8_t Z80::Execute(Z80 &cpu)
+{
+	return cpu.Decode(opcode);
+}
+
+template<uint8_t opcode>
+uint8_t Z80::ExecuteCB(Z80 &cpu)
+{
+	return cpu.PrefixCB(opcode);
+}
+
+#if Z80_DISPATCH == Z80_DISPATCH_TABLE || Z80_BLOCK_CACHE
+#define TABLE_ENTRY(op) &Z80::Execute<op>,
+#define TABLE_ENTRY_CB(op) &Z80::ExecuteCB<op>,
+const Z80::OpHandler Z80::opcodeTable[256] = { OPCODES(TABLE_ENTRY) };
+const Z80::OpHandler Z80::prefixCBTable[256] = { OPCODES(TABLE_ENTRY_CB) };
+#undef TABLE_ENTRY
+#undef TABLE_ENTRY_CB
+#endif
+
+uint8_t Z80::Dispatch(uint8_t opcode)
+{
+#if Z80_DISPATCH == Z80_DISPATCH_GOTO
+#define LABEL_ADDRESS(op) &&op_##op,
+#define LABEL_HANDLER(op) op_##op: return Decode(op);
+	static void *const labels[256] = { OPCODES(LABEL_ADDRESS) };
+	goto *labels[opcode];
+	OPCODES(LABEL_HANDLER)
+#undef LABEL_ADDRESS
+#undef LABEL_HANDLER
+#elif Z80_DISPATCH == Z80_DISPATCH_TABLE
+	return opcodeTable[opcode](*this);
+#else
+	return Decode(opcode);
+#endif
+}
+
+uint8_t Z80::DispatchCB(uint8_t opcode)
+{
+#if Z80_DISPATCH == Z80_DISPATCH_GOTO
+#define LABEL_ADDRESS(op) &&cb_##op,
+#define LABEL_HANDLER(op) cb_##op: return PrefixCB(op);
+	static void *const labels[256] = { OPCODES(LABEL_ADDRESS) };
+	goto *labels[opcode];
+	OPCODES(LABEL_HANDLER)
+#undef LABEL_ADDRESS
+#undef LABEL_HANDLER
+#elif Z80_DISPATCH == Z80_DISPATCH_TABLE
+	return prefixCBTable[opcode](*this);
+#else
+	return PrefixCB(opcode);
+#endif
+}
+
+#undef OPCODE_ROW
+#undef OPCODES
+
+#if Z80_BLOCK_CACHE
+// Length in bytes of each opcode, as fetched by Decode.
+static const uint8_t OPCODE_LENGTH[256] = {
+	1, 3, 1, 1, 1, 1, 2, 1, 3, 1, 1, 1, 1, 1, 2, 1,
+	1, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+	2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+	2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1,
+	1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1,
+	2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1,
+	2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1
+};
+
+// Cycles of each opcode as returned by Decode, conditional branches not taken.
+static const uint8_t OPCODE_CYCLES[256] = {
+	4, 12, 8, 8, 4, 4, 8, 4, 20, 8, 8, 8, 4, 4, 8, 4,
+	4, 12, 8, 8, 4, 4, 8, 4, 12, 8, 8, 8, 4, 4, 8, 4,
+	8, 12, 8, 8, 4, 4, 8, 4, 8, 8, 8, 8, 4, 4, 8, 4,
+	8, 12, 8, 8, 12, 12, 12, 4, 8, 8, 8, 8, 4, 4, 8, 4,
+	4, 4, 4, 4, 4, 4, 8, 4, 4, 4, 4, 4, 4, 4, 8, 4,
+	4, 4, 4, 4, 4, 4, 8, 4, 4, 4, 4, 4, 4, 4, 8, 4,
+	4, 4, 4, 4, 4, 4, 8, 4, 4, 4, 4, 4, 4, 4, 8, 4,
+	8, 8, 8, 8, 8, 8, 4, 8, 4, 4, 4, 4, 4, 4, 8, 4,
+	4, 4, 4, 4, 4, 4, 8, 4, 4, 4, 4, 4, 4, 4, 8, 4,
+	4, 4, 4, 4, 4, 4, 8, 4, 4, 4, 4, 4, 4, 4, 8, 4,
+	4, 4, 4, 4, 4, 4, 8, 4, 4, 4, 4, 4, 4, 4, 8, 4,
+	4, 4, 4, 4, 4, 4, 8, 4, 4, 4, 4, 4, 4, 4, 8, 4,
+	8, 12, 12, 16, 12, 16, 8, 16, 8, 16, 12, 0, 12, 24, 8, 16,
+	8, 12, 12, 0, 12, 16, 8, 16, 8, 16, 12, 0, 12, 0, 8, 16,
+	12, 12, 8, 0, 0, 16, 8, 16, 16, 4, 16, 0, 0, 0, 8, 16,
+	12, 12, 8, 4, 0, 16, 8, 16, 12, 8, 16, 4, 0, 0, 8, 16
+};
+
+// Opcodes that end a block: jumps, calls, returns, HALT, STOP, DI, EI and undefined opcodes.
+static bool EndsBlock(uint8_t opcode)
+{
+	switch(opcode)
+	{
+	case 0x10: case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: case 0x76:
+	case 0xc0: case 0xc2: case 0xc3: case 0xc4: case 0xc7: case 0xc8: case 0xc9:
+	case 0xca: case 0xcc: case 0xcd: case 0xcf: case 0xd0: case 0xd2: case 0xd3:
+	case 0xd4: case 0xd7: case 0xd8: case 0xd9: case 0xda: case 0xdb: case 0xdc:
+	case 0xdd: case 0xdf: case 0xe3: case 0xe4: case 0xe7: case 0xe9: case 0xeb:
+	case 0xec: case 0xed: case 0xef: case 0xf3: case 0xf4: case 0xf7: case 0xfb:
+	case 0xfc: case 0xfd: case 0xff:
+		return true;
+	}
+	return false;
+}
+
+uint32_t Z80::BlockKey(uint16_t addr)
+{
+	uint32_t bank = addr >= 0x4000 && addr < 0x8000 ? rom_bank : 0;
+	return (bank << 16) | addr;
+}
+
+Z80::Block &Z80::FindBlock(uint16_t addr)
+{
+	uint32_t key = BlockKey(addr);
+	int slot = addr & (BLOCK_LOOKUP_SIZE - 1);
+	if(block_lookup[slot] != nullptr && block_lookup_keys[slot] == key)
+	{
+		return *block_lookup[slot];
+	}
+	std::unordered_map<uint32_t, Block> &blocks = addr < 0x8000 ? rom_blocks : ram_blocks;
+	auto it = blocks.find(key);
+	Block &block = it != blocks.end() ? it->second : CompileBlock(blocks[key], addr);
+	block_lookup[slot] = &block;
+	block_lookup_keys[slot] = key;
+	return block;
+}
+
+Z80::Block &Z80::CompileBlock(Block &block, uint16_t addr)
+{
+	block.start = addr;
+	block.cycles = 0;
+#if Z80_JIT
+	block.hits = 0;
+	block.jit = nullptr;
+	block.jit_generation = 0;
+#endif
+	uint16_t region = addr & 0xc000;
+	for(;;)
+	{
+		MicroOp op;
+		uint8_t opcode = ReadMem(addr);
+		uint8_t length = OPCODE_LENGTH[opcode];
+		if(opcode == 0xcb)
+		{
+			uint8_t cb = ReadMem(addr + 1);
+			op.handler = prefixCBTable[cb];
+			op.pc = addr + 2;
+			op.cycles = (cb & 0x07) == 0x06 ? 16 : 8;
+			op.opcode = cb;
+			op.prefixed = true;
+		}
+		else
+		{
+			op.handler = opcodeTable[opcode];
+			op.pc = addr + 1;
+			op.cycles = OPCODE_CYCLES[opcode];
+			op.opcode = opcode;
+			op.prefixed = false;
+		}
+		block.ops.push_back(op);
+		for(uint16_t i = 0; i < length; i++)
+		{
+			uint16_t byte = addr + i;
+			if(byte >= 0xe000 && byte < 0xfe00)
+			{
+				byte -= 0x2000;
+			}
+			if(byte >= 0x8000)
+			{
+				ProtectCode(byte);
+				byte -= 0x8000;
+				code_map[byte >> 3] |= 1 << (byte & 7);
+			}
+		}
+		addr += length;
+		if(EndsBlock(opcode) || block.ops.size() == BLOCK_MAX_OPS || (addr & 0xc000) != region)
+		{
+			break;
+		}
+		block.cycles += op.cycles;
+	}
+	block.end = addr;
+	block.polling = nullptr;
+	int32_t polled;
+	if(IsPollingLoop(block, polled))
+	{
+		block.polling = &polling_loops[BlockKey(block.start)];
+		block.polling->polled = polled;
+	}
+	return block;
+}
+
+// Addresses that only change at an event: memory, IF, IE, TMA, TAC and the LCD registers.
+// DIV and TIMA count on their own, the joypad, serial and sound registers are left out.
+static bool IsQuiet(uint16_t addr)
+{
+	if(addr < 0xa000 || (addr >= 0xc000 && addr < 0xff00) || addr >= 0xff80)
+	{
+		return true;
+	}
+	return addr == 0xff06 || addr == 0xff07 || addr == 0xff0f || (addr >= 0xff40 && addr <= 0xff4b);
+}
+
+bool Z80::IsPollingLoop(const Block &block, int32_t &polled)
+{
+	const MicroOp &last = block.ops.back();
+	if(last.prefixed)
+	{
+		return false;
+	}
+	uint16_t target;
+	switch(last.opcode)
+	{
+	case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+		target = last.pc + 1 + (int8_t) ReadMem(last.pc);
+		break;
+	case 0xc2: case 0xc3: case 0xca: case 0xd2: case 0xda:
+		target = ReadMem(last.pc) | (ReadMem(last.pc + 1) << 8);
+		break;
+	default:
+		return false;
+	}
+	if(target != block.start)
+	{
+		return false;
+	}
+	// Only A and F are written, and A before it is read, so each iteration starts over.
+	polled = -1;
+	bool loaded = false;
+	for(size_t i = 0; i + 1 < block.ops.size(); i++)
+	{
+		const MicroOp &op = block.ops[i];
+		uint8_t opcode = op.opcode;
+		if(op.prefixed)
+		{
+			// BIT b,r
+			if(opcode < 0x40 || opcode >= 0x80 || (opcode & 0x07) == 0x06 || ((opcode & 0x07) == 0x07 && !loaded))
+			{
+				return false;
+			}
+			continue;
+		}
+		if(opcode >= 0xa0 && opcode < 0xc0 && (opcode & 0x07) != 0x06)
+		{
+			// AND, XOR, OR and CP of a register
+			if(!loaded)
+			{
+				return false;
+			}
+			continue;
+		}
+		uint16_t addr;
+		switch(opcode)
+		{
+		case 0x00:
+			break;
+		case 0x3e:
+		case 0x78: case 0x79: case 0x7a: case 0x7b: case 0x7c: case 0x7d:
+			loaded = true;
+			break;
+		case 0xe6: case 0xee: case 0xf6: case 0xfe:
+			if(!loaded)
+			{
+				return false;
+			}
+			break;
+		case 0xf0:
+		case 0xfa:
+			addr = opcode == 0xf0 ? 0xff00 | ReadMem(op.pc) : ReadMem(op.pc) | (ReadMem(op.pc + 1) << 8);
+			if(!IsQuiet(addr))
+			{
+				return false;
+			}
+			polled = addr;
+			loaded = true;
+			break;
+		default:
+			return false;
+		}
+	}
+	return true;
 }
 
-/////////////////////////////////////////////////////////////
+uint32_t Z80::SkipPolling(Block &block, uint32_t cycles, uint64_t deadline)
+{
+	// Only whole iterations, RunBlock stops the one the deadline falls in at the deadline.
+	uint64_t now = total_cycles + cycles;
+	if(now + cycles > deadline)
+	{
+		return 0;
+	}
+	uint32_t skipped = (uint32_t) ((deadline - now) / cycles * cycles);
+	block.polling->skips++;
+	block.polling->cycles += skipped;
+	return skipped;
+}
 
-// Push data to stack.
-void Z80::PUSH(uint16_t data)
+void Z80::InvalidateBlocks()
 {
-	uint8_t d = 0xff00 & data;
-	d >>= 8;
-	WriteMem(sp--, d);
-	d = 0x00ff & data;
-	WriteMem(sp--, d);
+	ram_blocks.clear();
+	memset(&block_lookup, 0, sizeof(block_lookup));
+	memset(&code_map, 0, sizeof(code_map));
+	code_dirty = false;
+	running_block = nullptr;
+	block_exit = false;
+	MapMemory();
 }
 
-// Pop data from stack to reg.
-void Z80::POP(uint16_t &reg)
+bool Z80::HasCode(int page)
 {
-	SetHiRegister(reg, ReadMem(sp++));
-	SetLoRegister(reg, ReadMem(sp++));
+	for(int i = (page - 0x80) * 32, end = i + 32; i < end; i++)
+	{
+		if(code_map[i] != 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void Z80::ProtectCode(uint16_t addr)
+{
+	int page = addr >> 8;
+	write_pages[page] = nullptr;
+	if(page >= 0xc0 && page < 0xde)
+	{
+		write_pages[page + 0x20] = nullptr;
+	}
 }
 
-// Move data to reg(pos can be "hi" or "lo").
-void Z80::LD8(uint16_t &reg, std::string pos, uint8_t data)
+uint32_t Z80::ExecuteBlock(uint64_t limit)
 {
-	if(pos == "hi")
+	if(code_dirty)
 	{
-		SetHiRegister(reg, data);
+		InvalidateBlocks();
 	}
-	else if(pos == "lo")
+	if(interrupts != 0)
 	{
-		SetLoRegister(reg, data);
+		// HALT and the instruction after EI, Tick checks interrupts after each instruction.
+		return StepInstruction();
 	}
-	else
+	Block &block = FindBlock(pc);
+	uint64_t deadline = std::min(scheduler.Next(), limit);
+	running_block = &block;
+	block_exit = false;
+	uint32_t cycles = RunBlock(block, (uint32_t) std::min<uint64_t>(deadline - total_cycles, UINT32_MAX));
+	running_block = nullptr;
+	if(block.polling != nullptr && pc == block.start && polling_skip)
+	{
+		cycles += SkipPolling(block, cycles, deadline);
+	}
+	return cycles;
+}
+
+uint32_t Z80::RunBlock(Block &block, uint32_t budget)
+{
+#if Z80_JIT
+	// Translated blocks run whole, only when the deadline falls at or after their last instruction.
+	if(jit_enabled && block.cycles < budget)
+	{
+		if(jit_verify)
+		{
+			return jit->Verify(*this, block);
+		}
+		if(block.jit != nullptr && block.jit_generation == jit->Generation())
+		{
+			return block.jit(this);
+		}
+		if(++block.hits >= JIT::HOT_THRESHOLD)
+		{
+			// Translation failures fall back to the interpreter, retried after another HOT_THRESHOLD runs.
+			block.hits = 0;
+			block.jit = jit->Compile(*this, block);
+			block.jit_generation = jit->Generation();
+			if(block.jit != nullptr)
+			{
+				return block.jit(this);
+			}
+		}
+	}
+#endif
+	const MicroOp *op = block.ops.data();
+	const MicroOp *last = op + block.ops.size() - 1;
+	uint32_t cycles = 0;
+	for(; op != last; op++)
+	{
+		pc = op->pc;
+		op->handler(*this);
+		cycles += op->cycles;
+		if(block_exit || cycles >= budget)
+		{
+			// The block wrote over cached code, stop before running stale instructions, wrote an
+			// I/O register, stop where a deadline it moved can be checked, or reached the deadline,
+			// stop where events run without blocks.
+			return cycles;
+		}
+	}
+	pc = last->pc;
+	return cycles + last->handler(*this);
+}
+#endif
+
+void Z80::EnableJIT([[maybe_unused]] bool enabled)
+{
+#if Z80_JIT
+	jit_enabled = enabled;
+	if(enabled && jit == nullptr)
+	{
+		jit.reset(new JIT());
+	}
+#endif
+}
+
+void Z80::VerifyJIT([[maybe_unused]] bool enabled)
+{
+#if Z80_JIT
+	EnableJIT(enabled || jit_enabled);
+	jit_verify = enabled;
+#endif
+}
+
+void Z80::EnablePollingSkip(bool enabled)
+{
+	polling_skip = enabled;
+}
+
+void Z80::ReportPollingLoops(std::ostream &out) const
+{
+	std::string title;
+	for(uint16_t addr = 0x134; addr < 0x144 && cartridge[addr] >= 0x20 && cartridge[addr] < 0x7f; addr++)
+	{
+		title += (char) cartridge[addr];
+	}
+	std::vector<std::pair<uint32_t, const PollingLoop *>> loops;
+	for(const auto &entry : polling_loops)
 	{
-		std::cout << "ERROR:LD8::INVALID_POS\n";
+		loops.emplace_back(entry.first, &entry.second);
 	}
+	std::sort(loops.begin(), loops.end(), [](const std::pair<uint32_t, const PollingLoop *> &a,
+		const std::pair<uint32_t, const PollingLoop *> &b) { return a.second->cycles > b.second->cycles; });
+	out << "polling loops in " << title << ", " << loops.size() << " found, " << total_cycles << " cycles run\n";
+	for(const auto &loop : loops)
+	{
+		out << std::hex << std::setfill('0') << std::setw(2) << (loop.first >> 16) << ':' << std::setw(4)
+			<< (loop.first & 0xffff) << " reads ";
+		if(loop.second->polled < 0)
+		{
+			out << "registers only";
+		}
+		else
+		{
+			out << std::setw(4) << loop.second->polled;
+		}
+		out << std::dec << ", " << loop.second->skips << " skips, " << loop.second->cycles << " cycles, "
+			<< (total_cycles ? 100.0 * loop.second->cycles / total_cycles : 0.0) << "% of the run\n";
+	}
+}
+
+/////////////////////////////////////////////////////////////
+
+// Push data to stack.
+void Z80::PUSH(uint16_t data)
+{
+	WriteMem(--sp, data >> 8);
+	WriteMem(--sp, data & 0x00ff);
+}
+
+// Pop data from stack to reg.
+void Z80::POP(uint16_t &reg)
+{
+	SetLoRegister(reg, ReadMem(sp++));
+	SetHiRegister(reg, ReadMem(sp++));
+}
+
+// Move data to register r.
+template<Z80::Reg8 r>
+void Z80::LD8(uint8_t data)
+{
+	Register<r>() = data;
 }
 
 // Move data to memory in addr.
@@ -2429,118 +3573,93 @@ void Z80::LD16(uint16_t &reg, uint16_t data)
 // Add data to accumulator. If carry is true, the value in FLAG_C is also added.
 void Z80::ADD8(uint8_t data, bool carry)
 {
-	uint16_t a = GetHiRegister(registers[AF]);
-	if(carry)
-	{
-		data += GetFlag(FLAG_C);
-	}
-	a += data;
-	SetFlag(FLAG_Z, a == 0);
-	SetFlag(FLAG_N, false);
-	SetFlag(FLAG_H, (((a & 0xf) + (data & 0xf)) & 0x10) == 0x10);
-	SetFlag(FLAG_C, a > 255);
-	SetHiRegister(registers[AF], (uint8_t) a);
+	uint8_t a = Register<Reg8::A>();
+	uint8_t c = carry ? GetFlag(FLAG_C) : 0;
+	uint8_t result = a + data + c;
+	SetFlags(FlagOp::ADD, a, data, c, result, a + data + c > 0xff);
+	Register<Reg8::A>() = result;
 }
 
 // Add reg to HL.
 void Z80::ADD16(uint16_t reg)
 {
+	uint16_t hl = registers[HL];
 	registers[HL] += reg;
+	SetFlag(FLAG_N, false);
+	SetFlag(FLAG_H, (hl & 0xfff) + (reg & 0xfff) > 0xfff);
+	SetFlag(FLAG_C, hl + reg > 0xffff);
 }
 
 // Add d(signed 8-bit integer) to SP.
 void Z80::ADD16(int8_t d)
 {
+	uint8_t e = (uint8_t) d;
+	SetFlag(FLAG_Z, false);
+	SetFlag(FLAG_N, false);
+	SetFlag(FLAG_H, (sp & 0xf) + (e & 0xf) > 0xf);
+	SetFlag(FLAG_C, (sp & 0xff) + e > 0xff);
 	sp += d;
 }
 
 // Subtract data to accumulator. If carry is true, the value in FLAG_C is also subtracted.
 void Z80::SUB(uint8_t data, bool carry)
 {
-	uint8_t a = GetHiRegister(registers[AF]);
-	if(carry)
-	{
-		data += GetFlag(FLAG_C);
-	}
-	a -= data;
-	SetFlag(FLAG_Z, a == 0);
-	SetFlag(FLAG_N, true);
-	SetFlag(FLAG_H, ((a & 0xf) - (data & 0xf)) < 0);
-	SetFlag(FLAG_C, a < 0);
-	SetHiRegister(registers[AF], (uint8_t) a);
+	uint8_t a = Register<Reg8::A>();
+	uint8_t c = carry ? GetFlag(FLAG_C) : 0;
+	uint8_t result = a - data - c;
+	SetFlags(FlagOp::SUB, a, data, c, result, a < data + c);
+	Register<Reg8::A>() = result;
 }
 
 // Bitwise & data to accumulator.
 void Z80::AND(uint8_t data)
 {
-	uint16_t a = GetHiRegister(registers[AF]);
-	a &= data;
-	SetFlag(FLAG_Z, a == 0);
-	SetFlag(FLAG_N, false);
-	SetFlag(FLAG_H, true);
-	SetFlag(FLAG_C, false);
-	SetHiRegister(registers[AF], (uint8_t) a);
+	uint8_t a = Register<Reg8::A>();
+	uint8_t result = a & data;
+	SetFlags(FlagOp::AND, a, data, 0, result, false);
+	Register<Reg8::A>() = result;
 }
 
 // Bitwise ^ data to accumulator.
 void Z80::XOR(uint8_t data)
 {
-	uint16_t a = GetHiRegister(registers[AF]);
-	a ^= data;
-	SetFlag(FLAG_Z, a == 0);
-	SetFlag(FLAG_N, false);
-	SetFlag(FLAG_H, false);
-	SetFlag(FLAG_C, false);
-	SetHiRegister(registers[AF], (uint8_t) a);
+	uint8_t a = Register<Reg8::A>();
+	uint8_t result = a ^ data;
+	SetFlags(FlagOp::OR, a, data, 0, result, false);
+	Register<Reg8::A>() = result;
 }
 
 // Bitwise | data to accumulator.
 void Z80::OR(uint8_t data)
 {
-	uint16_t a = GetHiRegister(registers[AF]);
-	a |= data;
-	SetFlag(FLAG_Z, a == 0);
-	SetFlag(FLAG_N, false);
-	SetFlag(FLAG_H, false);
-	SetFlag(FLAG_C, false);
-	SetHiRegister(registers[AF], (uint8_t) a);
+	uint8_t a = Register<Reg8::A>();
+	uint8_t result = a | data;
+	SetFlags(FlagOp::OR, a, data, 0, result, false);
+	Register<Reg8::A>() = result;
 }
 
 // Like SUB but accumulator is not modified, only the flags.
 void Z80::CP(uint8_t data)
 {
-	uint8_t a = GetHiRegister(registers[AF]);
-	a -= data;
-	SetFlag(FLAG_Z, a == 0);
-	SetFlag(FLAG_N, true);
-	SetFlag(FLAG_H, ((a & 0xf) - (data & 0xf)) < 0);
-	SetFlag(FLAG_C, a < 0);
+	uint8_t a = Register<Reg8::A>();
+	SetFlags(FlagOp::SUB, a, data, 0, a - data, a < data);
 }
 
-// Increments reg(pos can be "hi" or "lo").
-void Z80::INC8(uint16_t &reg, std::string pos)
+// Increments register r.
+template<Z80::Reg8 r>
+void Z80::INC8()
 {
-	uint8_t r = 0;
-	if(pos == "hi")
-	{
-		r = GetHiRegister(reg);
-		SetHiRegister(reg, ++r);
-	}
-	else if(pos == "lo")
-	{
-		r = GetLoRegister(reg);
-		SetLoRegister(reg, ++r);
-	}
-	else
-	{
-		std::cout << "ERROR:INC8::INVALID_POS\n";
-	}
+	uint8_t &reg = Register<r>();
+	SetFlags(FlagOp::INC, reg, 1, 0, reg + 1, GetFlag(FLAG_C));
+	reg++;
 }
 
 // Increments the value of memory in addr.
 void Z80::INC8(uint16_t addr)
 {
-	WriteMem(addr, ReadMem(addr) + 1);
+	uint8_t data = ReadMem(addr);
+	SetFlags(FlagOp::INC, data, 1, 0, data + 1, GetFlag(FLAG_C));
+	WriteMem(addr, data + 1);
 }
 
 // Increments reg.
@@ -2549,30 +3668,21 @@ void Z80::INC16(uint16_t &reg)
 	reg++;
 }
 
-// Decrements reg(pos can be "hi" or "lo").
-void Z80::DEC8(uint16_t &reg, std::string pos)
+// Decrements register r.
+template<Z80::Reg8 r>
+void Z80::DEC8()
 {
-	uint8_t r = 0;
-	if(pos == "hi")
-	{
-		r = GetHiRegister(reg);
-		SetHiRegister(reg, --r);
-	}
-	else if(pos == "lo")
-	{
-		r = GetLoRegister(reg);
-		SetLoRegister(reg, --r);
-	}
-	else
-	{
-		std::cout << "ERROR:DEC8::INVALID_POS\n";
-	}
+	uint8_t &reg = Register<r>();
+	SetFlags(FlagOp::DEC, reg, 1, 0, reg - 1, GetFlag(FLAG_C));
+	reg--;
 }
 
 // Decrements the value of memory in addr.
 void Z80::DEC8(uint16_t addr)
 {
-	WriteMem(addr, ReadMem(addr) - 1);
+	uint8_t data = ReadMem(addr);
+	SetFlags(FlagOp::DEC, data, 1, 0, data - 1, GetFlag(FLAG_C));
+	WriteMem(addr, data - 1);
 }
 
 // Decrements reg.
@@ -2584,35 +3694,24 @@ void Z80::DEC16(uint16_t &reg)
 // Decimal adjust the accumulator.
 void Z80::DAA()
 {
-	uint8_t a = GetHiRegister(registers[AF]);
-	uint8_t hn = (a & 0xf0) >> 4;
-	uint8_t ln = a & 0x0f;
-	if(!GetFlag(FLAG_N))
+	uint8_t a = Register<Reg8::A>();
+	uint8_t correction = 0;
+	bool n = GetFlag(FLAG_N);
+	bool c = GetFlag(FLAG_C);
+	if(GetFlag(FLAG_H) || (!n && (a & 0xf) > 9))
 	{
-		if(GetFlag(FLAG_H) || (a & 0xf) > 9)
-		{
-			a += 0x06;
-		}
-		if(GetFlag(FLAG_C) || a > 0x9f)
-		{
-			a += 0x60;
-		}
+		correction |= 0x06;
 	}
-	else
+	if(c || (!n && a > 0x99))
 	{
-		if(GetFlag(FLAG_H))
-		{
-			a = (a - 6) & 0xFF;
-		}
-		if(GetFlag(FLAG_C))
-		{
-			a -= 0x60;
-		}
+		correction |= 0x60;
+		c = true;
 	}
+	a = n ? a - correction : a + correction;
 	SetFlag(FLAG_Z, a == 0);
 	SetFlag(FLAG_H, false);
-	SetFlag(FLAG_C, (a & 0x100) == 0x100);
-	SetHiRegister(registers[AF], (uint8_t) a);
+	SetFlag(FLAG_C, c);
+	Register<Reg8::A>() = a;
 }
 
 // Bitwise ^ the accumulator to 0xff.
@@ -2628,7 +3727,7 @@ void Z80::CPL()
 // Rotate accumulator left.
 void Z80::RLCA()
 {
-	uint8_t a = GetHiRegister(registers[AF]);
+	uint8_t a = Register<Reg8::A>();
 	uint8_t c = (a & 0x80) >> 7;
 	a <<= 1;
 	a |= c;
@@ -2636,12 +3735,13 @@ void Z80::RLCA()
 	SetFlag(FLAG_N, false);
 	SetFlag(FLAG_H, false);
 	SetFlag(FLAG_C, c);
+	Register<Reg8::A>() = a;
 }
 
 // Rotate accumulator left through carry.
 void Z80::RLA()
 {
-	uint8_t a = GetHiRegister(registers[AF]);
+	uint8_t a = Register<Reg8::A>();
 	uint8_t c = (a & 0x80) >> 7;
 	uint8_t f = GetFlag(FLAG_C);
 	a <<= 1;
@@ -2650,59 +3750,47 @@ void Z80::RLA()
 	SetFlag(FLAG_N, false);
 	SetFlag(FLAG_H, false);
 	SetFlag(FLAG_C, c);
+	Register<Reg8::A>() = a;
 }
 
 // Rotate accumulator right.
 void Z80::RRCA()
 {
-	uint8_t a = GetHiRegister(registers[AF]);
-	uint8_t c = (a & 0x01) << 7;
+	uint8_t a = Register<Reg8::A>();
+	uint8_t c = a & 0x01;
 	a >>= 1;
-	a |= c;
+	a |= c << 7;
 	SetFlag(FLAG_Z, false);
 	SetFlag(FLAG_N, false);
 	SetFlag(FLAG_H, false);
 	SetFlag(FLAG_C, c);
+	Register<Reg8::A>() = a;
 }
 
 // Rotate accumulator right through carry.
 void Z80::RRA()
 {
-	uint8_t a = GetHiRegister(registers[AF]);
-	uint8_t c = (a & 0x01) << 7;
+	uint8_t a = Register<Reg8::A>();
+	uint8_t c = a & 0x01;
 	uint8_t f = GetFlag(FLAG_C);
 	a >>= 1;
-	a |= f;
+	a |= f << 7;
 	SetFlag(FLAG_Z, false);
 	SetFlag(FLAG_N, false);
 	SetFlag(FLAG_H, false);
 	SetFlag(FLAG_C, c);
+	Register<Reg8::A>() = a;
 }
 
-// Rotate reg(pos can be "hi" or "lo") left.
-void Z80::RLC(uint16_t &reg, std::string pos)
+// Rotate register r left.
+template<Z80::Reg8 r>
+void Z80::RLC()
 {
-	uint8_t r = 0;
-	uint8_t c = (r & 0x80) >> 7;
-	if(pos == "hi")
-	{
-		r = GetHiRegister(reg);
-		r <<= 1;
-		r |= c;
-		SetHiRegister(reg, r);
-	}
-	else if(pos == "lo")
-	{
-		r = GetLoRegister(reg);
-		r <<= 1;
-		r |= c;
-		SetLoRegister(reg, r);
-	}
-	else
-	{
-		std::cout << "ERROR:RLC::INVALID_POS\n";
-	}
-	SetFlag(FLAG_Z, r == 0);
+	uint8_t &reg = Register<r>();
+	uint8_t c = (reg & 0x80) >> 7;
+	reg <<= 1;
+	reg |= c;
+	SetFlag(FLAG_Z, reg == 0);
 	SetFlag(FLAG_N, false);
 	SetFlag(FLAG_H, false);
 	SetFlag(FLAG_C, c);
@@ -2722,31 +3810,16 @@ void Z80::RLC()
 	SetFlag(FLAG_C, c);
 }
 
-// Rotate reg(pos can be "hi" or "lo") left through carry.
-void Z80::RL(uint16_t &reg, std::string pos)
+// Rotate register r left through carry.
+template<Z80::Reg8 r>
+void Z80::RL()
 {
-	uint8_t r = 0;
-	uint8_t c = (r & 0x80) >> 7;
+	uint8_t &reg = Register<r>();
+	uint8_t c = (reg & 0x80) >> 7;
 	uint8_t f = GetFlag(FLAG_C);
-	if(pos == "hi")
-	{
-		r = GetHiRegister(reg);
-		r <<= 1;
-		r |= f;
-		SetHiRegister(reg, r);
-	}
-	else if(pos == "lo")
-	{
-		r = GetLoRegister(reg);
-		r <<= 1;
-		r |= f;
-		SetLoRegister(reg, r);
-	}
-	else
-	{
-		std::cout << "ERROR:RL::INVALID_POS\n";
-	}
-	SetFlag(FLAG_Z, r == 0);
+	reg <<= 1;
+	reg |= f;
+	SetFlag(FLAG_Z, reg == 0);
 	SetFlag(FLAG_N, false);
 	SetFlag(FLAG_H, false);
 	SetFlag(FLAG_C, c);
@@ -2767,30 +3840,15 @@ void Z80::RL()
 	SetFlag(FLAG_C, c);
 }
 
-// Rotate reg(pos can be "hi" or "lo") right.
-void Z80::RRC(uint16_t &reg, std::string pos)
+// Rotate register r right.
+template<Z80::Reg8 r>
+void Z80::RRC()
 {
-	uint8_t r = 0;
-	uint8_t c = (r & 0x01) << 7;
-	if(pos == "hi")
-	{
-		r = GetHiRegister(reg);
-		r >>= 1;
-		r |= c;
-		SetHiRegister(reg, r);
-	}
-	else if(pos == "lo")
-	{
-		r = GetLoRegister(reg);
-		r >>= 1;
-		r |= c;
-		SetLoRegister(reg, r);
-	}
-	else
-	{
-		std::cout << "ERROR:RRC::INVALID_POS\n";
-	}
-	SetFlag(FLAG_Z, r == 0);
+	uint8_t &reg = Register<r>();
+	uint8_t c = reg & 0x01;
+	reg >>= 1;
+	reg |= c << 7;
+	SetFlag(FLAG_Z, reg == 0);
 	SetFlag(FLAG_N, false);
 	SetFlag(FLAG_H, false);
 	SetFlag(FLAG_C, c);
@@ -2800,9 +3858,9 @@ void Z80::RRC(uint16_t &reg, std::string pos)
 void Z80::RRC()
 {
 	uint8_t data = ReadMem(registers[HL]);
-	uint8_t c = (data & 0x01) << 7;
+	uint8_t c = data & 0x01;
 	data >>= 1;
-	data |= c;
+	data |= c << 7;
 	WriteMem(registers[HL], data);
 	SetFlag(FLAG_Z, data == 0);
 	SetFlag(FLAG_N, false);
@@ -2810,31 +3868,16 @@ void Z80::RRC()
 	SetFlag(FLAG_C, c);
 }
 
-// Rotate reg(pos can be "hi" or "lo") right through carry.
-void Z80::RR(uint16_t &reg, std::string pos)
+// Rotate register r right through carry.
+template<Z80::Reg8 r>
+void Z80::RR()
 {
-	uint8_t r = 0;
-	uint8_t c = (r & 0x01) << 7;
+	uint8_t &reg = Register<r>();
+	uint8_t c = reg & 0x01;
 	uint8_t f = GetFlag(FLAG_C);
-	if(pos == "hi")
-	{
-		r = GetHiRegister(reg);
-		r >>= 1;
-		r |= f;
-		SetHiRegister(reg, r);
-	}
-	else if(pos == "lo")
-	{
-		r = GetLoRegister(reg);
-		r >>= 1;
-		r |= f;
-		SetLoRegister(reg, r);
-	}
-	else
-	{
-		std::cout << "ERROR:RR::INVALID_POS\n";
-	}
-	SetFlag(FLAG_Z, r == 0);
+	reg >>= 1;
+	reg |= f << 7;
+	SetFlag(FLAG_Z, reg == 0);
 	SetFlag(FLAG_N, false);
 	SetFlag(FLAG_H, false);
 	SetFlag(FLAG_C, c);
@@ -2844,10 +3887,10 @@ void Z80::RR(uint16_t &reg, std::string pos)
 void Z80::RR()
 {
 	uint8_t data = ReadMem(registers[HL]);
-	uint8_t c = (data & 0x01) << 7;
+	uint8_t c = data & 0x01;
 	uint8_t f = GetFlag(FLAG_C);
 	data >>= 1;
-	data |= f;
+	data |= f << 7;
 	WriteMem(registers[HL], data);
 	SetFlag(FLAG_Z, data == 0);
 	SetFlag(FLAG_N, false);
@@ -2855,28 +3898,14 @@ void Z80::RR()
 	SetFlag(FLAG_C, c);
 }
 
-// Shift reg(pos can be "hi" or "lo") left.
-void Z80::SLA(uint16_t &reg, std::string pos)
+// Shift register r left.
+template<Z80::Reg8 r>
+void Z80::SLA()
 {
-	uint8_t r = 0;
-	uint8_t c = (r & 0x80) >> 7;
-	if(pos == "hi")
-	{
-		r = GetHiRegister(reg);
-		r <<= 1;
-		SetHiRegister(reg, r);
-	}
-	else if(pos == "lo")
-	{
-		r = GetLoRegister(reg);
-		r <<= 1;
-		SetLoRegister(reg, r);
-	}
-	else
-	{
-		std::cout << "ERROR:SLA::INVALID_POS\n";
-	}
-	SetFlag(FLAG_Z, r == 0);
+	uint8_t &reg = Register<r>();
+	uint8_t c = (reg & 0x80) >> 7;
+	reg <<= 1;
+	SetFlag(FLAG_Z, reg == 0);
 	SetFlag(FLAG_N, false);
 	SetFlag(FLAG_H, false);
 	SetFlag(FLAG_C, c);
@@ -2895,31 +3924,16 @@ void Z80::SLA()
 	SetFlag(FLAG_C, c);
 }
 
-// Shift reg(pos can be 'hi" or "lo") left.
-void Z80::SRA(uint16_t &reg, std::string pos)
+// Shift register r right, bit 7 is kept.
+template<Z80::Reg8 r>
+void Z80::SRA()
 {
-	uint8_t r = 0;
-	uint8_t c = (r & 0x01) << 7;
-	uint8_t b7 = (r & 0x80);
-	if(pos == "hi")
-	{
-		r = GetHiRegister(reg);
-		r >>= 1;
-		r |= b7;
-		SetHiRegister(reg, r);
-	}
-	else if(pos == "lo")
-	{
-		r = GetLoRegister(reg);
-		r >>= 1;
-		r |= b7;
-		SetLoRegister(reg, r);
-	}
-	else
-	{
-		std::cout << "ERROR:SRA::INVALID_POS\n";
-	}
-	SetFlag(FLAG_Z, r == 0);
+	uint8_t &reg = Register<r>();
+	uint8_t c = reg & 0x01;
+	uint8_t b7 = reg & 0x80;
+	reg >>= 1;
+	reg |= b7;
+	SetFlag(FLAG_Z, reg == 0);
 	SetFlag(FLAG_N, false);
 	SetFlag(FLAG_H, false);
 	SetFlag(FLAG_C, c);
@@ -2929,7 +3943,7 @@ void Z80::SRA(uint16_t &reg, std::string pos)
 void Z80::SRA()
 {
 	uint8_t data = ReadMem(registers[HL]);
-	uint8_t c = (data & 0x01) << 7;
+	uint8_t c = data & 0x01;
 	uint8_t b7 = (data & 0x80);
 	data >>= 1;
 	data |= b7;
@@ -2940,33 +3954,15 @@ void Z80::SRA()
 	SetFlag(FLAG_C, c);
 }
 
-// Swap reg(pos can be "hi" or "lo") low/hi nibble.
-void Z80::SWAP(uint16_t &reg, std::string pos)
+// Swap register r's low/hi nibble.
+template<Z80::Reg8 r>
+void Z80::SWAP()
 {
-	uint8_t r = 0;
-	uint8_t hn = 0;
-	uint8_t ln = 0;
-	if(pos == "hi")
-	{
-		r = GetHiRegister(reg);
-		hn = (r & 0xf0) >> 4;
-		ln = (r & 0x0f) << 4;
-		r = ln | hn;
-		SetHiRegister(reg, ln);
-	}
-	else if(pos == "lo")
-	{
-		r = GetLoRegister(reg);
-		hn = (r & 0xf0) >> 4;
-		ln = (r & 0x0f) << 4;
-		r = ln | hn;
-		SetLoRegister(reg, r);
-	}
-	else
-	{
-		std::cout << "ERROR:SWAP::INVALID_POS\n";
-	}
-	SetFlag(FLAG_Z, r == 0);
+	uint8_t &reg = Register<r>();
+	uint8_t hn = (reg & 0xf0) >> 4;
+	uint8_t ln = (reg & 0x0f) << 4;
+	reg = ln | hn;
+	SetFlag(FLAG_Z, reg == 0);
 	SetFlag(FLAG_N, false);
 	SetFlag(FLAG_H, false);
 	SetFlag(FLAG_C, false);
@@ -2986,28 +3982,14 @@ void Z80::SWAP()
 	SetFlag(FLAG_C, false);
 }
 
-// Shift reg(pos can be "hi" or "lo") right logical.
-void Z80::SRL(uint16_t &reg, std::string pos)
+// Shift register r right logically.
+template<Z80::Reg8 r>
+void Z80::SRL()
 {
-	uint8_t r = 0;
-	uint8_t c = (r & 0x01) << 7;
-	if(pos == "hi")
-	{
-		r = GetHiRegister(reg);
-		r >>= 1;
-		SetHiRegister(reg, r);
-	}
-	else if(pos == "lo")
-	{
-		r = GetLoRegister(reg);
-		r >>= 1;
-		SetLoRegister(reg, r);
-	}
-	else
-	{
-		std::cout << "ERROR:SRA::INVALID_POS\n";
-	}
-	SetFlag(FLAG_Z, r == 0);
+	uint8_t &reg = Register<r>();
+	uint8_t c = reg & 0x01;
+	reg >>= 1;
+	SetFlag(FLAG_Z, reg == 0);
 	SetFlag(FLAG_N, false);
 	SetFlag(FLAG_H, false);
 	SetFlag(FLAG_C, c);
@@ -3017,7 +3999,7 @@ void Z80::SRL(uint16_t &reg, std::string pos)
 void Z80::SRL()
 {
 	uint8_t data = ReadMem(registers[HL]);
-	uint8_t c = (data & 0x01) << 7;
+	uint8_t c = data & 0x01;
 	data >>= 1;
 	WriteMem(registers[HL], data);
 	SetFlag(FLAG_Z, data == 0);
@@ -3026,26 +4008,12 @@ void Z80::SRL()
 	SetFlag(FLAG_C, c);
 }
 
-// Test bit n of reg(pos can be "hi" or "lo").
-void Z80::BIT(uint16_t &reg, std::string pos, int n)
+// Test bit n of register r.
+template<Z80::Reg8 r>
+void Z80::BIT(int n)
 {
-	uint8_t r = 0;
-	if(pos == "hi")
-	{
-		r = GetHiRegister(reg);
-	}
-	else if(pos == "lo")
-	{
-		r = GetLoRegister(reg);
-	}
-	else
-	{
-		std::cout << "ERROR:BIT::INVALID_POS\n";
-	}
 	uint8_t setter = 1 << n;
-	r &= setter;
-	r >>= n;
-	SetFlag(FLAG_Z, r == 0);
+	SetFlag(FLAG_Z, (Register<r>() & setter) == 0);
 	SetFlag(FLAG_N, false);
 	SetFlag(FLAG_H, true);
 }
@@ -3062,27 +4030,12 @@ void Z80::BIT(int n)
 	SetFlag(FLAG_H, true);
 }
 
-// Set bit n of reg(pos can be "hi" or "lo").
-void Z80::SET(uint16_t &reg, std::string pos, int n)
+// Set bit n of register r.
+template<Z80::Reg8 r>
+void Z80::SET(int n)
 {
-	uint8_t r = 0;
 	uint8_t setter = 1 << n;
-	if(pos == "hi")
-	{
-		r = GetHiRegister(reg);
-		r |= setter;
-		SetHiRegister(reg, r);
-	}
-	else if(pos == "lo")
-	{
-		r = GetLoRegister(reg);
-		r |= setter;
-		SetLoRegister(reg, r);
-	}
-	else
-	{
-		std::cout << "ERROR:SET::INVALID_POS\n";
-	}
+	Register<r>() |= setter;
 }
 
 // Set bit n of the data in memory at (HL).
@@ -3094,28 +4047,13 @@ void Z80::SET(int n)
 	WriteMem(registers[HL], data);
 }
 
-// Reset bin n of reg(pos can be "hi" or "lo").
-void Z80::RES(uint16_t &reg, std::string pos, int n)
+// Reset bit n of register r.
+template<Z80::Reg8 r>
+void Z80::RES(int n)
 {
-	uint8_t r = 0;
 	uint8_t setter = 1 << n;
 	setter ^= 0xff;
-	if(pos == "hi")
-	{
-		r = GetHiRegister(reg);
-		r &= setter;
-		SetHiRegister(reg, r);
-	}
-	else if(pos == "lo")
-	{
-		r = GetLoRegister(reg);
-		r &= setter;
-		SetLoRegister(reg, r);
-	}
-	else
-	{
-		std::cout << "ERROR:RES::INVALID_POS\n";
-	}
+	Register<r>() &= setter;
 }
 
 // Reset bit n of the data in memory at (HL).
@@ -3137,7 +4075,7 @@ void Z80::JP(uint16_t nn)
 // Jump to HL.
 void Z80::JP()
 {
-	pc = ReadMem(registers[HL]);
+	pc = registers[HL];
 }
 
 // Conditional jump, f can be NZ, Z, NC, C.|
@@ -3324,6 +4262,7 @@ void Z80::RETI()
 {
 	POP(pc);
 	IME = true;
+	UpdateInterrupts();
 }
 
 // Push present address onto stack. Jump to address $0000 + n.
@@ -3336,49 +4275,58 @@ void Z80::RST(uint8_t n)
 // Toggles carry flag.
 void Z80::CCF()
 {
+	SetFlag(FLAG_N, false);
+	SetFlag(FLAG_H, false);
 	SetFlag(FLAG_C, GetFlag(FLAG_C) ^ 1);
 }
 
 // Sets carry flag.
 void Z80::SCF()
 {
+	SetFlag(FLAG_N, false);
+	SetFlag(FLAG_H, false);
 	SetFlag(FLAG_C, 1);
 }
 
-// Halts until interrupt occurs.
+// Halts until IE & IF, the interrupt is serviced if IME is set.
 void Z80::HALT()
 {
-	if(IME)
+	if(memory[IE] & memory[IF] & INTERRUPTS)
 	{
-		bool halt = false;
-		uint8_t IE = ReadMem(0xff0f);
-		for(int i = 0; i < 4; i++)
-		{
-			uint8_t setter = 1 << i;
-			halt = (IE & setter) == 1 ? true : false;
-		}
-		if(halt)
-		{
-			pc--;
-		}
+		halted = false;
+		UpdateInterrupts();
+		return;
 	}
+	// Tick skips the time, if the run ends first HALT is executed again.
+	halted = true;
+	pc--;
+	UpdateInterrupts();
 }
 
-// Standby mode.
+// Standby mode, until a joypad interrupt is requested.
 void Z80::STOP()
 {
+	halted = true;
+	stopped = true;
 	pc--;
+	UpdateInterrupts();
 }
 
 // disable interrupts, IME = false;
 void Z80::DI()
 {
 	IME = false;
+	ime_delay = false;
+	UpdateInterrupts();
 }
 
-// enables interrupts, IME = true;
+// enables interrupts after the next instruction, IME = true;
 void Z80::EI()
 {
-	IME = true;
+	if(!IME)
+	{
+		ime_delay = true;
+		UpdateInterrupts();
+	}
 }
 
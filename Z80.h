@@ -25,8 +25,15 @@
 #include <string>
 #include <stdint.h>
 #include <vector>
+#include <unordered_map>
+#include <memory>
 #include <iostream>
 
+#include "PPU.h"
+#include "RTC.h"
+#include "Scheduler.h"
+#include "Timer.h"
+
 constexpr int AF = 0;
 constexpr int BC = 1;
 constexpr int DE = 2;
@@ -37,18 +44,136 @@ constexpr int FLAG_N = 2;
 constexpr int FLAG_H = 1;
 constexpr int FLAG_C = 0;
 
+/*
+	Opcode dispatch engines, selected at build time by defining Z80_DISPATCH.
+	SWITCH - Decode/PrefixCB switch statements.
+	TABLE  - 256 + 256 entry handler tables, one handler per opcode.
+	GOTO   - Computed goto into per-opcode labels (GCC/Clang only).
+*/
+#define Z80_DISPATCH_SWITCH 0
+#define Z80_DISPATCH_TABLE 1
+#define Z80_DISPATCH_GOTO 2
+
+#ifndef Z80_DISPATCH
+#if defined(__GNUC__)
+#define Z80_DISPATCH Z80_DISPATCH_GOTO
+#else
+#define Z80_DISPATCH Z80_DISPATCH_TABLE
+#endif
+#endif
+
+#if Z80_DISPATCH == Z80_DISPATCH_GOTO && !defined(__GNUC__)
+#error "Z80_DISPATCH_GOTO requires GCC or Clang"
+#endif
+
+/*
+	Lazy flags, disabled by defining Z80_LAZY_FLAGS to 0.
+	ALU operations record their operands and result instead of computing F,
+	the flags are only computed when something reads them.
+*/
+#ifndef Z80_LAZY_FLAGS
+#define Z80_LAZY_FLAGS 1
+#endif
+
+/*
+	Cached interpreter, disabled by defining Z80_BLOCK_CACHE to 0.
+	Straight-line runs of instructions are decoded once per (bank, address) into
+	blocks of handlers, then executed without fetching and dispatching each opcode.
+*/
+#ifndef Z80_BLOCK_CACHE
+#define Z80_BLOCK_CACHE 1
+#endif
+
+/*
+	x86-64 translation of hot blocks, disabled by defining Z80_JIT to 0.
+	Can also be switched off at runtime with Z80::EnableJIT.
+*/
+#ifndef Z80_JIT
+#if Z80_BLOCK_CACHE && (defined(__x86_64__) || defined(_M_X64))
+#define Z80_JIT 1
+#else
+#define Z80_JIT 0
+#endif
+#endif
+
+#if Z80_JIT && !Z80_BLOCK_CACHE
+#error "Z80_JIT requires Z80_BLOCK_CACHE"
+#endif
+
+#if defined(_MSC_VER)
+#define Z80_FORCEINLINE __forceinline
+#else
+#define Z80_FORCEINLINE inline __attribute__((always_inline))
+#endif
+
+
+class JIT;
+class RomImage;
+class SaveRam;
 
 class Z80
 {
+	friend class Benchmark;
+	friend class JIT;
 public:
 	Z80();
-	bool LoadCartridge(std::string path);
+	~Z80();
+	// Loads the ROM at path, returns false if it cannot be read. With save, the RAM of a battery-backed
+	// cartridge is kept in the .sav file next to it, see SaveRam::Open, otherwise it starts empty and is not saved.
+	bool LoadCartridge(std::string path, bool save = false);
+	// Replaces the cartridge with image, which may be shared with other instances.
+	// Cartridge RAM starts empty and is not saved.
+	void InsertCartridge(std::shared_ptr<const RomImage> image);
+	// Schedules the cartridge RAM written since the last call to be saved, RunFrame calls it every SAVE_FLUSH_FRAMES.
+	void FlushSave();
 	void LoadInfo();
 	void Init();
+	// Switches translation of hot blocks on or off, on by default with Z80_JIT.
+	void EnableJIT(bool enabled);
+	// Runs translated blocks one instruction at a time against the interpreter and reports differences.
+	void VerifyJIT(bool enabled);
+	// Switches skipping of polling loops on or off, on by default with Z80_BLOCK_CACHE. A block that
+	// loops on itself only reading memory that events change jumps to the next event in one go,
+	// runs are the same either way.
+	void EnablePollingSkip(bool enabled);
+	// Writes the polling loops found in the ROM, the address each one reads and the time skipped in it.
+	void ReportPollingLoops(std::ostream &out) const;
+	// Switches drawing into screen on or off from the next frame, for example to render every Nth
+	// frame. LY, STAT and the LCD interrupts run the same either way.
+	void SetRendering(bool enabled);
+	// Draws frames straight into the host's buffer, rows of 160 pixels in format pitch bytes apart,
+	// see Renderer::SetOutput. nullptr goes back to drawing into screen.
+	void SetFrameBuffer(void *pixels, size_t pitch, PixelFormat format);
+	// Lines of the last complete frame that differ from the frame drawn before it, with their
+	// changed columns. Damage::Rects merges them into rectangles. Call after SyncScreen.
+	Renderer::Damage LastDamage() const;
+	// Moves drawing to a worker thread so the CPU runs ahead of it, frames are the same pixel for pixel.
+	void EnableRenderThread(bool enabled);
+	// Waits for the render thread to draw everything run so far, screen must not be read before.
+	void SyncScreen();
+	static constexpr uint32_t SAVE_FLUSH_FRAMES = 60;
+	// T-states in one frame, 154 lines of 456.
+	static constexpr uint32_t FRAME_CYCLES = 70224;
+	// Runs at least cycles T-states, returns the cycles taken, at most one instruction more than asked.
+	uint32_t RunCycles(uint32_t cycles);
+	// Runs one frame, less what the previous frame overshot. Returns the cycles taken.
+	uint32_t RunFrame();
+	// Runs until done() returns true or max_cycles have run, returns the cycles taken.
+	// done is checked before every instruction, blocks are not used.
+	template<typename Predicate> uint32_t RunUntil(Predicate done, uint32_t max_cycles);
 private:
-	enum class CartridgeType{ROM = 0, MBC1 = 1, MBC2 = 2, OTHER = 3};
+	enum class CartridgeType{ROM = 0, MBC1 = 1, MBC2 = 2, MBC3 = 3, MBC5 = 4, OTHER = 5};
 	CartridgeType cartridgeType;
-	uint8_t rom_bank, ram_bank;
+	// rom_bank is 9 bits wide on MBC5, ram_bank selects an RTC register from 0x08 on MBC3.
+	uint16_t rom_bank;
+	uint8_t ram_bank;
+	// Banks in rom, a power of two.
+	uint32_t rom_banks;
+	// Cartridge RAM, ram_banks 8 KiB banks, a power of two. Saved to a .sav file with battery.
+	std::unique_ptr<SaveRam> sram;
+	uint32_t ram_banks;
+	bool battery;
+	uint32_t frames_since_flush;
 	bool ram_enabled, rom_ram_mode;
 	/*
 		Registers
@@ -64,33 +189,250 @@ private:
 		Bit 4(0): Carry flag(C)
 	*/
 	uint16_t registers[4];
+	// 8-bit registers, in register pair order so r / 2 is the pair and even r the high byte.
+	enum class Reg8{A = 0, F = 1, B = 2, C = 3, D = 4, E = 5, H = 6, L = 7};
 	uint16_t sp;
 	uint16_t pc;
-	uint8_t cartridge[0x200000];
+	// ROM image, mapped into 0x0000-0x7fff by pointer. Shared by every instance running the same ROM.
+	std::shared_ptr<const RomImage> rom;
+	// rom->Data().
+	const uint8_t *cartridge;
 	uint8_t memory[0x10000];
 	uint8_t screen[144][160];
-	uint8_t cycle_count;
+	// Renders into screen from memory, advanced by SyncPPU when its next event is due.
+	PPU ppu;
+	// Cycles run since power on, the clock RTC time and the scheduler's deadlines are counted in.
+	// Advanced after each instruction, or after each block with Z80_BLOCK_CACHE, see Now.
+	uint64_t total_cycles;
+	// Deadlines of the peripherals, checked by Tick.
+	Scheduler scheduler;
+	// total_cycles the PPU has been advanced to.
+	uint64_t ppu_synced;
+	// DIV and TIMA, computed from total_cycles when read.
+	Timer timer;
+	// Cycles left of the instruction run by Cycle.
+	uint32_t cycle_count;
+	// Cycles the last RunFrame ran past its frame.
+	uint32_t frame_overshoot;
 	bool IME;
+	// EI ran, IME is set at the next instruction boundary so the instruction after it runs first.
+	bool ime_delay;
+	// HALT or STOP ran, pc stays on the opcode until an interrupt request wakes the CPU.
+	bool halted;
+	bool stopped;
+	// End of the RunCycles in progress, a halted CPU skips ahead no further.
+	uint64_t run_end;
+	// IE & IF & 0x1f while IME is set, 0x80 while ime_delay, 0x40 while halted. Tick only tests
+	// this byte, it is recomputed by UpdateInterrupts whenever IE, IF, IME or halted change.
+	uint8_t interrupts;
 	enum class RelFlag{NZ = 0, Z = 1, NC = 2, C = 3 };
 	uint8_t ReadMem(uint16_t addr);
 	void WriteMem(uint16_t addr, uint8_t data);
+	/* MEMORY MAP */
+	// Base of each 256-byte page, indexed by addr >> 8. A null page takes the slow path:
+	// I/O registers, MBC registers, disabled RAM, MBC3 clock registers and, for writes, pages holding cached code.
+	const uint8_t *read_pages[0x100];
+	uint8_t *write_pages[0x100];
+	uint8_t ReadSlow(uint16_t addr);
+	void WriteSlow(uint16_t addr, uint8_t data);
+	// Write to the I/O registers at 0xff00-0xff7f.
+	void WriteIO(uint16_t addr, uint8_t data);
+	// Points every page at its memory for the current banks and RAM enable.
+	void MapMemory();
+	// Points 0x4000-0x7fff at rom_bank inside cartridge, bank switches never copy.
+	void MapROM();
+	/* MAPPERS */
+	// Policies for WriteROM, defined in Mappers.h.
+	struct RomOnly;
+	struct MBC1;
+	struct MBC2;
+	struct MBC3;
+	struct MBC5;
+	// MBC3 clock.
+	RTC rtc;
+	// True while ram_bank selects a clock register, 0x08-0x0c on MBC3. The other mappers use every
+	// bit of ram_bank for RAM.
+	bool ClockMapped() const;
+	typedef void (*MapperWrite)(Z80 &cpu, uint16_t addr, uint8_t data);
+	// WriteROM for the mapper of the cartridge, chosen by LoadInfo.
+	MapperWrite mapper_write;
+	// Write to 0x0000-0x7fff, Mapper::Write updates the banks and the pages that changed are remapped.
+	template<class Mapper> static void WriteROM(Z80 &cpu, uint16_t addr, uint8_t data);
 	uint8_t GetHiRegister(uint16_t reg);
 	uint8_t GetLoRegister(uint16_t reg);
 	void SetHiRegister(uint16_t &reg, uint8_t data);
 	void SetLoRegister(uint16_t &reg, uint8_t data);
+	// Byte of register r inside registers, selected at compile time.
+	template<Reg8 r> uint8_t &Register();
 	void SetFlag(int bit, bool value);
 	bool GetFlag(int bit);
+	/* FLAGS */
+	// ALU operations that set all four flags from their operands and result.
+	enum class FlagOp{ADD = 0, SUB = 1, AND = 2, OR = 3, INC = 4, DEC = 5};
+	// Last ALU operation, F is computed from it while flags_pending is true.
+	// C is cheap to get while executing the operation so it is stored instead of derived.
+	struct PendingFlags
+	{
+		FlagOp op;
+		uint8_t a;
+		uint8_t b;
+		// Carry in for ADD/SUB.
+		uint8_t carry;
+		uint8_t result;
+		bool c;
+	};
+	PendingFlags pending_flags;
+	bool flags_pending;
+	// Computes F after the ALU operation in flags.
+	static uint8_t ComputeFlags(const PendingFlags &flags);
+	// Sets the flags of an ALU operation, deferred until read when Z80_LAZY_FLAGS is enabled.
+	void SetFlags(FlagOp op, uint8_t a, uint8_t b, uint8_t carry, uint8_t result, bool c);
+	// Writes the pending flags to F, needed before F is read or saved as a whole.
+	void FlushFlags();
+	// Drops the pending flags, needed after F is overwritten as a whole.
+	void DiscardFlags();
 	void Cycle();
+	// Executes the instruction at pc, or the cached block starting at pc with Z80_BLOCK_CACHE. Returns the cycles taken.
+	uint32_t Step();
+	// Executes the instruction at pc, returns the cycles taken.
+	uint32_t StepInstruction();
+	// StepInstruction, then the events and interrupt due after it. Returns the cycles taken.
+	uint32_t RunInstruction();
+	// Advances the clock by cycles run by the CPU, runs the events that came due, then
+	// services a pending interrupt.
+	void Tick(uint32_t cycles);
+	// Runs every event due at total_cycles.
+	void RunEvents();
+	// Cycles run up to the start of the instruction running: total_cycles plus, inside a block,
+	// the cycles of the instructions of the block before it. The PPU, timer and RTC are read
+	// and written at this time.
+	uint64_t Now() const;
+	// Brings the PPU up to Now().
+	void SyncPPU();
+	// Schedules the PPU's next event from its state at Now(), after SyncPPU or a Reset.
+	void SchedulePPU();
+	// Schedules the next TIMA overflow, after the timer was advanced or written.
+	void ScheduleTimer();
+	// Recomputes interrupts.
+	void UpdateInterrupts();
+	// Called by Tick while interrupts is set: runs the instruction after EI, skips time while
+	// halted, or calls the handler of the highest priority interrupt requested.
+	void ServiceInterrupts();
+	// Moves total_cycles to the next time an enabled interrupt can be requested, until the
+	// halted CPU is woken or run_end is reached. Nothing but the events can change IE or IF meanwhile.
+	void Idle();
 	uint8_t Fetch();
 	uint8_t Decode(uint8_t opcode);
 	uint8_t PrefixCB(uint8_t opcode);
+	/* DISPATCH */
+	typedef uint8_t (*OpHandler)(Z80 &cpu);
+	static const OpHandler opcodeTable[256];
+	static const OpHandler prefixCBTable[256];
+	// Decode specialised for a single opcode, used to fill the handler tables.
+	template<uint8_t opcode> static uint8_t Execute(Z80 &cpu);
+	// PrefixCB specialised for a single opcode, used to fill the handler tables.
+	template<uint8_t opcode> static uint8_t ExecuteCB(Z80 &cpu);
+	// Execute opcode with the engine selected by Z80_DISPATCH.
+	uint8_t Dispatch(uint8_t opcode);
+	// Execute the CB prefixed opcode with the engine selected by Z80_DISPATCH.
+	uint8_t DispatchCB(uint8_t opcode);
+	/* BLOCK CACHE */
+	// Translated block, returns the cycles taken like ExecuteBlock.
+	typedef uint32_t (*JitCode)(Z80 *cpu);
+	static constexpr size_t BLOCK_MAX_OPS = 16;
+	static constexpr int BLOCK_LOOKUP_SIZE = 4096;
+	// Most cycles a block can take, BLOCK_MAX_OPS of the slowest instruction.
+	static constexpr uint32_t BLOCK_MAX_CYCLES = BLOCK_MAX_OPS * 24;
+	// Decoded instruction, handler is called with pc at its first operand.
+	struct MicroOp
+	{
+		OpHandler handler;
+		uint16_t pc;
+		uint8_t cycles;
+		// Opcode, or the byte after 0xcb when prefixed.
+		uint8_t opcode;
+		bool prefixed;
+	};
+	// Block that branches back to its own start and only loads A from memory and tests it, so
+	// every iteration does the same until an event changes memory.
+	struct PollingLoop
+	{
+		// Address loaded, -1 if the loop only tests registers.
+		int32_t polled;
+		// Times iterations were skipped, and the cycles they took.
+		uint64_t skips;
+		uint64_t cycles;
+	};
+	// Straight-line run of instructions, ends at a jump, call, return, HALT, STOP, DI, EI,
+	// a 16 KiB region boundary or after BLOCK_MAX_OPS instructions.
+	struct Block
+	{
+		std::vector<MicroOp> ops;
+		// Cycles of every instruction but the last, which may be a branch.
+		uint16_t cycles;
+		uint16_t start;
+		uint16_t end;
+		// Entry in polling_loops if the block is one, nullptr otherwise.
+		PollingLoop *polling;
+#if Z80_JIT
+		// Times the block ran in the interpreter, it is translated at JIT::HOT_THRESHOLD.
+		uint32_t hits;
+		JitCode jit;
+		// JIT::Generation() when jit was translated.
+		uint32_t jit_generation;
+#endif
+	};
+	// Blocks keyed by BlockKey, code in RAM is kept apart so it can be dropped when overwritten.
+	std::unordered_map<uint32_t, Block> rom_blocks;
+	std::unordered_map<uint32_t, Block> ram_blocks;
+	// Direct mapped cache in front of rom_blocks and ram_blocks, indexed by the low address bits.
+	Block *block_lookup[BLOCK_LOOKUP_SIZE];
+	uint32_t block_lookup_keys[BLOCK_LOOKUP_SIZE];
+	// One bit per byte of 0x8000-0xffff, set when the byte belongs to a cached block.
+	uint8_t code_map[0x1000];
+	// Set by WriteMem when a byte in code_map is written.
+	bool code_dirty;
+	// Block run by ExecuteBlock, nullptr between blocks.
+	const Block *running_block;
+	// Set when the running block has to stop after the current instruction: it wrote over cached
+	// code or wrote an I/O register, which can move a deadline.
+	bool block_exit;
+	// Polling loops by BlockKey, kept when blocks in RAM are dropped.
+	std::unordered_map<uint32_t, PollingLoop> polling_loops;
+	bool polling_skip;
+	// Bank and address of a block, bank is only used in the switchable ROM area.
+	uint32_t BlockKey(uint16_t addr);
+	Block &FindBlock(uint16_t addr);
+	Block &CompileBlock(Block &block, uint16_t addr);
+	// Drops every block in RAM.
+	void InvalidateBlocks();
+	// True if page, from 0x80, holds bytes of a cached block.
+	bool HasCode(int page);
+	// Sends writes to the page of addr, and its echo, through WriteSlow to catch writes over cached code.
+	void ProtectCode(uint16_t addr);
+	// Runs the block starting at pc up to the instruction reaching the next event or limit, so
+	// events run at the same instruction boundaries as without blocks. Returns the cycles taken.
+	uint32_t ExecuteBlock(uint64_t limit);
+	// Runs block, stopping after the instruction that takes the cycles run to budget.
+	uint32_t RunBlock(Block &block, uint32_t budget);
+	// True if block is a PollingLoop reading only memory that changes at events, polled is set to the address it reads.
+	bool IsPollingLoop(const Block &block, int32_t &polled);
+	// Cycles of the further iterations of block, each taking cycles, that end by deadline.
+	// They change nothing, so they are only counted.
+	uint32_t SkipPolling(Block &block, uint32_t cycles, uint64_t deadline);
+	/* JIT */
+#if Z80_JIT
+	std::unique_ptr<JIT> jit;
+	bool jit_enabled;
+	bool jit_verify;
+#endif
 	/* OPCODES */
 	// Push data to stack.
 	void PUSH(uint16_t data);
 	// Pop data from stack to reg.
 	void POP(uint16_t &reg);
-	// Move data to reg(pos can be "hi" or "lo").
-	void LD8(uint16_t &reg, std::string pos, uint8_t data);
+	// Move data to register r.
+	template<Reg8 r> void LD8(uint8_t data);
 	// Move data to memory in addr.
 	void LD8(uint16_t addr, uint8_t data);
 	// Move data to reg.
@@ -111,14 +453,14 @@ private:
 	void OR(uint8_t data);
 	// Like SUB but accumulator is not modified, only the flags.
 	void CP(uint8_t data);
-	// Increments reg(pos can be "hi" or "lo").
-	void INC8(uint16_t &reg, std::string pos);
+	// Increments register r.
+	template<Reg8 r> void INC8();
 	// Increments the value of memory in addr.
 	void INC8(uint16_t addr);
 	// Increments reg.
 	void INC16(uint16_t &reg);
-	// Decrements reg(pos can be "hi" or "lo").
-	void DEC8(uint16_t &reg, std::string pos);
+	// Decrements register r.
+	template<Reg8 r> void DEC8();
 	// Decrements the value of memory in addr.
 	void DEC8(uint16_t addr);
 	// Decrements reg.
@@ -136,48 +478,48 @@ private:
 	// Rotate accumulator right through carry.
 	void RRA();
 	/* PREFIX CB OPCODES */
-	// Rotate reg(pos can be "hi" or "lo") left.
-	void RLC(uint16_t &reg, std::string pos);
+	// Rotate register r left.
+	template<Reg8 r> void RLC();
 	// Rotate the data in memory at (HL) left.
 	void RLC();
-	// Rotate reg(pos can be "hi" or "lo") left through carry.
-	void RL(uint16_t &reg, std::string pos);
+	// Rotate register r left through carry.
+	template<Reg8 r> void RL();
 	// Rotate the data in memory at (HL) left through carry.
 	void RL();
-	// Rotate reg(pos can be "hi" or "lo") right.
-	void RRC(uint16_t &reg, std::string pos);
+	// Rotate register r right.
+	template<Reg8 r> void RRC();
 	// Rotate the data in memory at (HL) right.
 	void RRC();
-	// Rotate reg(pos can be "hi" or "lo") right through carry.
-	void RR(uint16_t &reg, std::string pos);
+	// Rotate register r right through carry.
+	template<Reg8 r> void RR();
 	// Rotate the data in memory at (HL) right through carry.
 	void RR();
-	// Shift reg(pos can be "hi" or "lo") left.
-	void SLA(uint16_t &reg, std::string pos);
+	// Shift register r left.
+	template<Reg8 r> void SLA();
 	// Shift the data in memory at (HL) left.
 	void SLA();
-	// Shift reg(pos can be 'hi" or "lo") right.
-	void SRA(uint16_t &reg, std::string pos);
+	// Shift register r right, bit 7 is kept.
+	template<Reg8 r> void SRA();
 	// Shift the data in memory at (HL) right.
 	void SRA();
-	// Swap reg(pos can be "hi" or "lo")'s low/hi nibble.
-	void SWAP(uint16_t &reg, std::string pos);
+	// Swap register r's low/hi nibble.
+	template<Reg8 r> void SWAP();
 	// Swap the data in memory at (HL)'s low/hi nibble.
 	void SWAP();
-	// Shift reg(pos can be "hi" or "lo") right logically.
-	void SRL(uint16_t &reg, std::string pos);
+	// Shift register r right logically.
+	template<Reg8 r> void SRL();
 	// Shift the data in memory at (HL) right logically.
 	void SRL();
-	// Test bit n of reg(pos can be "hi" or "lo").
-	void BIT(uint16_t &reg, std::string pos, int n);
+	// Test bit n of register r.
+	template<Reg8 r> void BIT(int n);
 	// Test bit n of the data in memory at (HL).
 	void BIT(int n);
-	// Set bit n of reg(pos can be "hi" or "lo").
-	void SET(uint16_t &reg, std::string pos, int n);
+	// Set bit n of register r.
+	template<Reg8 r> void SET(int n);
 	// Set bit n of the data in memory at (HL).
 	void SET(int n);
-	// Reset bin n of reg(pos can be "hi" or "lo").
-	void RES(uint16_t &reg, std::string pos, int n);
+	// Reset bit n of register r.
+	template<Reg8 r> void RES(int n);
 	// Reset bit n of the data in memory at (HL).
 	void RES(int n);
 	// Jump to nn.
@@ -206,12 +548,22 @@ private:
 	void CCF();
 	// Sets carry flag.
 	void SCF();
-	// Halts until interrupt occurs.
+	// Halts until IE & IF, the interrupt is serviced if IME is set.
 	void HALT();
-	// Standby mode.
+	// Standby mode, until a joypad interrupt is requested.
 	void STOP();
 	// disable interrupts, IME = false;
 	void DI();
-	// enables interrupts, IME = true;
+	// enables interrupts after the next instruction, IME = true;
 	void EI();
-};
\ No newline at end of file
+};
+template<typename Predicate> uint32_t Z80::RunUntil(Predicate done, uint32_t max_cycles)
+{
+	uint64_t start = total_cycles;
+	run_end = start + max_cycles;
+	while(total_cycles < run_end && !done())
+	{
+		RunInstruction();
+	}
+	return (uint32_t) (total_cycles - start);
+}